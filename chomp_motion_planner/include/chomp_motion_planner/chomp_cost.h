@@ -39,13 +39,20 @@
 
 #include <eigen3/Eigen/Core>
 #include <chomp_motion_planner/chomp_trajectory.h>
+#include <chomp_motion_planner/chomp_utils.h>
 #include <vector>
+#include <algorithm>
 
 namespace chomp
 {
 
 /**
  * \brief Represents the smoothness cost for CHOMP, for a single joint
+ *
+ * The quadratic cost is banded, since every differentiation rule only spans
+ * DIFF_RULE_LENGTH points, so it is stored as its lower band together with a
+ * banded LDL^T factorization of the free variable block.  Applying the inverse
+ * is then a pair of triangular solves, linear in the number of points.
  */
 class ChompCost
 {
@@ -56,9 +63,30 @@ public:
   template<typename Derived>
   void getDerivative(Eigen::MatrixXd::ColXpr joint_trajectory, Eigen::MatrixBase<Derived>& derivative) const;
 
-  const Eigen::MatrixXd& getQuadraticCostInverse() const;
+  /**
+   * \brief Replaces the vector (over the free variables) by the inverse of the quadratic cost times it
+   */
+  void applyQuadraticCostInverse(Eigen::VectorXd& vector) const;
+
+  /**
+   * \brief Replaces the vector by L^-T D^-1/2 times it, so independent standard normal samples
+   * become samples with the inverse of the quadratic cost as their covariance
+   */
+  void applyQuadraticCostInverseFactor(Eigen::VectorXd& vector) const;
+
+  /**
+   * \brief Gets one column of the inverse of the quadratic cost
+   */
+  void getQuadraticCostInverseColumn(int index, Eigen::VectorXd& column) const;
+
+  double getQuadraticCostInverseDiagonal(int index) const;
 
-  const Eigen::MatrixXd& getQuadraticCost() const;
+  /**
+   * \brief Builds the dense inverse of the quadratic cost, which takes a solve per column
+   */
+  Eigen::MatrixXd getQuadraticCostInverse() const;
+
+  Eigen::MatrixXd getQuadraticCost() const;
 
   double getCost(Eigen::MatrixXd::ColXpr joint_trajectory) const;
 
@@ -66,34 +94,63 @@ public:
 
   void scale(double scale);
 
+  static const int BANDWIDTH = DIFF_RULE_LENGTH-1;
+
 private:
-  Eigen::MatrixXd quad_cost_full_;
-  Eigen::MatrixXd quad_cost_;
-  //Eigen::VectorXd linear_cost_;
-  Eigen::MatrixXd quad_cost_inv_;
+  int num_vars_free_;
+  int free_start_;
+
+  // lower band of the quad cost for all variables, entry (i,k) holds element (i,i-k)
+  Eigen::MatrixXd quad_cost_full_band_;
 
-  Eigen::MatrixXd getDiffMatrix(int size, const double* diff_rule) const;
+  // factorization of the free variable block, entry (i,k) of the band holds L(i,i-k)
+  Eigen::MatrixXd quad_cost_factor_band_;
+  Eigen::VectorXd quad_cost_factor_diagonal_;
+
+  Eigen::VectorXd quad_cost_inv_diagonal_;
+
+  double getFullQuadCost(int i, int j) const;
+
+  void factorizeQuadCost();
 };
 
-template<typename Derived>
-void ChompCost::getDerivative(Eigen::MatrixXd::ColXpr joint_trajectory, Eigen::MatrixBase<Derived>& derivative) const
+inline double ChompCost::getFullQuadCost(int i, int j) const
 {
-  derivative = (quad_cost_full_ * (2.0 * joint_trajectory));
+  return (i >= j) ? quad_cost_full_band_(i, i-j) : quad_cost_full_band_(j, j-i);
 }
 
-inline const Eigen::MatrixXd& ChompCost::getQuadraticCostInverse() const
+template<typename Derived>
+void ChompCost::getDerivative(Eigen::MatrixXd::ColXpr joint_trajectory, Eigen::MatrixBase<Derived>& derivative) const
 {
-  return quad_cost_inv_;
+  int size = joint_trajectory.rows();
+  for (int i=0; i<size; i++)
+  {
+    double sum = 0.0;
+    int end = std::min(size-1, i+BANDWIDTH);
+    for (int j=std::max(0, i-BANDWIDTH); j<=end; j++)
+      sum += getFullQuadCost(i, j) * joint_trajectory(j);
+    derivative(i) = 2.0 * sum;
+  }
 }
 
-inline const Eigen::MatrixXd& ChompCost::getQuadraticCost() const
+inline double ChompCost::getQuadraticCostInverseDiagonal(int index) const
 {
-  return quad_cost_;
+  return quad_cost_inv_diagonal_(index);
 }
 
 inline double ChompCost::getCost(Eigen::MatrixXd::ColXpr joint_trajectory) const
 {
-  return joint_trajectory.dot(quad_cost_full_ * joint_trajectory);
+  int size = joint_trajectory.rows();
+  double cost = 0.0;
+  for (int i=0; i<size; i++)
+  {
+    // diagonal once, the symmetric lower band twice
+    double sum = 0.5 * quad_cost_full_band_(i, 0) * joint_trajectory(i);
+    for (int k=1; k<=BANDWIDTH && k<=i; k++)
+      sum += quad_cost_full_band_(i, k) * joint_trajectory(i-k);
+    cost += 2.0 * sum * joint_trajectory(i);
+  }
+  return cost;
 }
 
 } // namespace chomp
@@ -40,13 +40,21 @@
 #include <chomp_motion_planner/chomp_parameters.h>
 #include <chomp_motion_planner/chomp_trajectory.h>
 #include <chomp_motion_planner/chomp_cost.h>
-#include <chomp_motion_planner/multivariate_gaussian.h>
+#include <chomp_motion_planner/ChompOptimizationReport.h>
 #include <planning_models/kinematic_model.h>
 #include <collision_proximity/collision_proximity_space.h>
 
 #include <eigen3/Eigen/Core>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/function.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/mersenne_twister.hpp>
 
 #include <vector>
+#include <stdint.h>
 
 namespace chomp
 {
@@ -63,6 +71,33 @@ public:
 
   void optimize();
 
+  /**
+   * \brief Makes optimize() stop at the start of its next iteration, keeping the best trajectory so far
+   *
+   * Safe to call from another thread.
+   */
+  void cancel();
+
+  bool isCancelled() const;
+
+  inline bool isCollisionFree() const
+  {
+    return is_collision_free_;
+  }
+
+  inline double getBestTrajectoryCost() const
+  {
+    return best_group_trajectory_cost_;
+  }
+
+  /**
+   * \brief Iteration counts, per phase timings and costs of the last call to optimize()
+   */
+  inline const chomp_motion_planner::ChompOptimizationReport& getReport() const
+  {
+    return report_;
+  }
+
   inline void destroy()
   {
     //Nothing for now.
@@ -93,12 +128,12 @@ private:
     return potential;
   }
   template<typename Derived>
-  void getJacobian(int trajectoryPoint,Eigen::Vector3d& collision_point_pos, std::string& jointName, Eigen::MatrixBase<Derived>& jacobian) const;
+  void getJacobian(int trajectoryPoint,Eigen::Vector3d& collision_point_pos, const uint64_t* joint_mask, Eigen::MatrixBase<Derived>& jacobian) const;
 
   void getRandomState(const planning_models::KinematicState* currentState, const std::string& groupName,
                       Eigen::VectorXd& state_vec);
 
-  void setRobotStateFromPoint(ChompTrajectory& group_trajectory, int i);
+  void setRobotStateFromPoint(ChompTrajectory& group_trajectory, int i, int worker);
 
   collision_proximity::CollisionProximitySpace::TrajectorySafety checkCurrentIterValidity();
 
@@ -119,7 +154,10 @@ private:
   ChompTrajectory group_trajectory_;
   std::vector<ChompCost> joint_costs_;
 
-  std::vector<std::vector<std::string> > collision_point_joint_names_;
+  static const int JOINT_MASK_WORD_BITS = 64;
+
+  int num_joint_mask_words_;
+  std::vector<uint64_t> collision_point_joint_masks_; /**< num_joint_mask_words_ words per collision point, bit j set if group joint j moves it */
   std::vector<std::vector<Eigen::Vector3d > > collision_point_pos_eigen_;
   std::vector<std::vector<Eigen::Vector3d > > collision_point_vel_eigen_;
   std::vector<std::vector<Eigen::Vector3d > > collision_point_acc_eigen_;
@@ -138,23 +176,49 @@ private:
   Eigen::MatrixXd momentum_;
   Eigen::MatrixXd random_momentum_;
   Eigen::VectorXd random_joint_momentum_; //temporary variable
-  std::vector<MultivariateGaussian> multivariate_gaussian_;
+  boost::variate_generator<boost::mt19937, boost::normal_distribution<> > momentum_gaussian_; /**< Momentum is sampled through the banded factors of the joint costs */
   double stochasticity_factor_;
 
   std::vector<int> state_is_in_collision_;      /**< Array containing a boolean about collision info for each point in the trajectory */
   std::vector<std::vector<int> > point_is_in_collision_;
   bool is_collision_free_;
+  bool cancelled_;
+  mutable boost::mutex cancel_mutex_;
+  chomp_motion_planner::ChompOptimizationReport report_;
   double worst_collision_cost_state_;
 
+  // copies of the robot state and proximity query contexts, one for each forward kinematics worker
+  std::vector<planning_models::KinematicState*> worker_states_;
+  std::vector<collision_proximity::CollisionProximitySpace::GroupStateContext> worker_contexts_;
+
+  // the group's joint and link states in each worker state, so forward kinematics doesn't look them up by name
+  std::vector<planning_models::KinematicState::JointStateGroup*> worker_joint_state_groups_;
+  std::vector<std::vector<const planning_models::KinematicState::JointState*> > worker_joint_states_;
+  std::vector<std::vector<const planning_models::KinematicState::LinkState*> > worker_parent_link_states_;
+
+  // jacobian scratch space, one for each collision increment worker
+  std::vector<Eigen::MatrixXd> worker_jacobians_;
+  std::vector<Eigen::MatrixXd> worker_jacobian_pseudo_inverses_;
+  std::vector<Eigen::MatrixXd> worker_jacobian_jacobian_tranposes_;
+
+  // threads for workers 1 and up, started in initialize() and kept for every iteration.
+  // runWorkers() hands them a job and does worker 0's share on the calling thread
+  boost::thread_group worker_threads_;
+  boost::mutex worker_mutex_;
+  boost::condition_variable worker_job_condition_;
+  boost::condition_variable worker_done_condition_;
+  boost::function<void (int)> worker_job_;
+  unsigned int worker_job_generation_;
+  int worker_jobs_pending_;
+  bool workers_exiting_;
+
   Eigen::MatrixXd smoothness_increments_;
   Eigen::MatrixXd collision_increments_;
   Eigen::MatrixXd final_increments_;
 
   // temporary variables for all functions:
   Eigen::VectorXd smoothness_derivative_;
-  Eigen::MatrixXd jacobian_;
-  Eigen::MatrixXd jacobian_pseudo_inverse_;
-  Eigen::MatrixXd jacobian_jacobian_tranpose_;
+  Eigen::VectorXd joint_increment_;
   Eigen::VectorXd random_state_;
   Eigen::VectorXd joint_state_velocities_;
 
@@ -162,6 +226,14 @@ private:
   ros::Publisher vis_marker_pub_;
 
   std::vector<std::string> joint_names_;
+
+  // joint model data for the group, resolved once in initialize()
+  std::vector<const planning_models::KinematicModel::JointModel*> joint_models_;
+  std::vector<tf::Vector3> joint_model_axes_;               /**< Joint axis in the joint frame, zero if it has none */
+  std::vector<tf::Transform> joint_origin_transforms_;
+  std::vector<bool> joint_is_continuous_;
+  std::vector<double> joint_min_;
+  std::vector<double> joint_max_;
   std::map<std::string, std::map<std::string, bool> > joint_parent_map_;
 
   inline bool isParent(const std::string& childLink, const std::string& parentLink) const
@@ -184,8 +256,12 @@ private:
   void initialize();
   void calculateSmoothnessIncrements();
   void calculateCollisionIncrements();
+  void calculateCollisionIncrements(int worker, int num_workers, int start, int end);
   void calculateTotalIncrements();
   void performForwardKinematics();
+  void performForwardKinematics(int worker, int start, int end);
+  void runWorkers(const boost::function<void (int)>& job);
+  void workerThread(int worker);
   void addIncrementsToTrajectory();
   void updateFullTrajectory();
   void debugCost();
@@ -200,8 +276,9 @@ private:
   void getRandomMomentum();
   void updateMomentum();
   void updatePositionFromMomentum();
-  void calculatePseudoInverse();
-  void computeJointProperties(int trajectoryPoint);
+  void calculatePseudoInverse(const Eigen::MatrixXd& jacobian, Eigen::MatrixXd& jacobian_jacobian_tranpose,
+                              Eigen::MatrixXd& jacobian_pseudo_inverse) const;
+  void computeJointProperties(int trajectoryPoint, int worker);
 
 };
 
@@ -79,6 +79,7 @@ public:
   double getRandomJumpAmount() const;
   void setRandomJumpAmount(double amount);
   bool getUseStochasticDescent() const;
+  int getNumThreads() const;
 
 private:
   double planning_time_limit_;
@@ -107,6 +108,7 @@ private:
   double collision_threshold_;
   bool filter_mode_;
   double random_jump_amount_;
+  int num_threads_;
 };
 
 /////////////////////// inline functions follow ////////////////////////
@@ -251,6 +253,11 @@ inline bool ChompParameters::getUseStochasticDescent() const
   return use_stochastic_descent_;
 }
 
+inline int ChompParameters::getNumThreads() const
+{
+  return num_threads_;
+}
+
 inline std::string ChompParameters::getAnimateEndeffectorSegment() const
 {
   return animate_endeffector_segment_;
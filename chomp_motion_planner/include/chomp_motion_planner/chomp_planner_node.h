@@ -46,15 +46,20 @@
 
 
 #include <chomp_motion_planner/chomp_parameters.h>
+#include <chomp_motion_planner/trajectory_library.h>
 #include <collision_proximity/collision_proximity_space.h>
 #include <map>
 #include <string>
 #include <filters/filter_chain.h>
 #include <eigen3/Eigen/Core>
+#include <boost/thread/mutex.hpp>
 
 namespace chomp
 {
 
+class ChompTrajectory;
+class ChompOptimizer;
+
 /**
  * \brief ROS Node which responds to motion planning requests using the CHOMP algorithm.
  */
@@ -108,10 +113,28 @@ private:
   double trajectory_discretization_;                    /**< Default discretization of the planned motion */
   ros::Publisher vis_marker_array_publisher_;           /**< Publisher for marker arrays */
   ros::Publisher vis_marker_publisher_;                 /**< Publisher for markers */
+  ros::Publisher optimization_report_publisher_;        /**< Publisher for per-request optimization reports */
   std::map<std::string, double> joint_velocity_limits_; /**< Map of joints to velocity limits */
   bool use_trajectory_filter_;
   int maximum_spline_points_;
   int minimum_spline_points_;
+  int num_planning_starts_;                             /**< Number of optimizers run concurrently for each request */
+
+  TrajectoryLibrary trajectory_library_;               /**< Collision free solutions, used to seed similar requests */
+  bool use_trajectory_library_;
+  std::string trajectory_library_file_;                 /**< Where the library is loaded from and saved to, if anywhere */
+
+  boost::mutex multi_start_mutex_;
+  int multi_start_winner_;                              /**< First start to finish collision free, -1 if none has */
+
+  /**
+   * \brief Adds a random detour to a min jerk trajectory, through a via point halfway along
+   */
+  void addRandomViaPoint(ChompTrajectory& trajectory);
+
+  void runOptimizer(int start, const std::vector<ChompOptimizer*>& optimizers);
+
+  void publishOptimizationReport(const ChompOptimizer& optimizer, const std::string& group_name, int start, bool selected);
 
   std::map<std::string, arm_navigation_msgs::JointLimits> joint_limits_;
   void getLimits(const trajectory_msgs::JointTrajectory& trajectory, 
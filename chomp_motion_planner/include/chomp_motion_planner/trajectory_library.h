@@ -0,0 +1,126 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/** \author Mrinal Kalakrishnan */
+
+#ifndef TRAJECTORY_LIBRARY_H_
+#define TRAJECTORY_LIBRARY_H_
+
+#include <eigen3/Eigen/Core>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace chomp
+{
+
+/**
+ * \brief Stores solved group trajectories so similar requests can start from them
+ *
+ * Trajectories are keyed by their start and goal points concatenated, and
+ * each group has a k-d tree over the keys for nearest neighbour lookups.  The
+ * tree is rebuilt lazily on the first lookup after the group changes.
+ */
+class TrajectoryLibrary
+{
+public:
+  TrajectoryLibrary();
+  virtual ~TrajectoryLibrary();
+
+  /**
+   * \brief Sets how many trajectories are kept per group, and how far (in joint space) a stored
+   * trajectory's endpoints may be from a request's for it to be used
+   */
+  void setParameters(unsigned int max_size, double max_distance);
+
+  /**
+   * \brief Marks which of the group's joints wrap around, so differences in them are taken the short
+   * way round when comparing endpoints
+   */
+  void setContinuousJoints(const std::string& group_name, const std::vector<bool>& continuous);
+
+  /**
+   * \brief Adds a trajectory (points in rows, group joints in columns)
+   *
+   * A stored trajectory with practically the same endpoints is replaced, otherwise the oldest one
+   * is dropped once the group is full.
+   */
+  void addTrajectory(const std::string& group_name, const Eigen::MatrixXd& trajectory);
+
+  /**
+   * \brief Fills in the nearest stored trajectory, resampled to the given number of points and
+   * warped to start and end at the given points
+   *
+   * \return false if the group has no stored trajectory within the maximum distance
+   */
+  bool getInitialTrajectory(const std::string& group_name, const Eigen::VectorXd& start, const Eigen::VectorXd& goal,
+                            int num_points, Eigen::MatrixXd& trajectory);
+
+  bool load(const std::string& filename);
+  bool save(const std::string& filename) const;
+
+  unsigned int size() const;
+  void clear();
+
+private:
+  struct GroupLibrary
+  {
+    GroupLibrary() : tree_valid(false) {}
+
+    std::vector<Eigen::VectorXd> keys;     /**< Start and goal points of each trajectory, concatenated */
+    std::vector<Eigen::MatrixXd> trajectories;
+    std::vector<int> tree;                 /**< Trajectory indices, each node is the median of its range */
+    std::vector<int> split_dimensions;     /**< Dimension each node of the tree splits on, -1 if it can't prune */
+    std::vector<bool> continuous;          /**< Whether each joint wraps around, the keys hold them normalized */
+    bool tree_valid;
+  };
+
+  unsigned int max_size_;
+  double max_distance_;
+  std::map<std::string, GroupLibrary> groups_;
+
+  static Eigen::VectorXd makeKey(const GroupLibrary& group, const Eigen::VectorXd& start, const Eigen::VectorXd& goal);
+  static bool isContinuousDimension(const GroupLibrary& group, int dimension);
+  static double getKeyDifference(const GroupLibrary& group, const Eigen::VectorXd& a, const Eigen::VectorXd& b,
+                                 int dimension);
+
+  void buildTree(GroupLibrary& group, int begin, int end);
+  void searchTree(const GroupLibrary& group, const Eigen::VectorXd& key, int begin, int end,
+                  int& nearest, double& nearest_distance_sq) const;
+  int findNearest(GroupLibrary& group, const Eigen::VectorXd& key, double& distance);
+};
+
+}
+
+#endif /* TRAJECTORY_LIBRARY_H_ */
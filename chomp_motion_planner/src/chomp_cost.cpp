@@ -36,7 +36,8 @@
 
 #include <chomp_motion_planner/chomp_cost.h>
 #include <chomp_motion_planner/chomp_utils.h>
-#include <eigen3/Eigen/LU>
+#include <boost/thread/mutex.hpp>
+#include <map>
 
 using namespace Eigen;
 using namespace std;
@@ -44,64 +45,191 @@ using namespace std;
 namespace chomp
 {
 
+// costs only depend on the trajectory length, discretization and weights, so
+// unscaled ones are kept for the life of the process and copied out by later
+// optimizers.  The cache is cleared once it holds this many costs
+static const unsigned int MAX_CACHED_COSTS = 64;
+static boost::mutex cost_cache_mutex;
+static map<vector<double>, ChompCost> cost_cache;
+
 ChompCost::ChompCost(const ChompTrajectory& trajectory, int joint_number, const std::vector<double>& derivative_costs, double ridge_factor)
 {
+  vector<double> key;
+  key.push_back(trajectory.getNumPoints());
+  key.push_back(trajectory.getDiscretization());
+  key.push_back(ridge_factor);
+  key.insert(key.end(), derivative_costs.begin(), derivative_costs.end());
+  {
+    boost::mutex::scoped_lock lock(cost_cache_mutex);
+    map<vector<double>, ChompCost>::const_iterator it = cost_cache.find(key);
+    if (it != cost_cache.end())
+    {
+      *this = it->second;
+      return;
+    }
+  }
+
   int num_vars_all = trajectory.getNumPoints();
-  int num_vars_free = num_vars_all - 2*(DIFF_RULE_LENGTH-1);
-  MatrixXd diff_matrix = MatrixXd::Zero(num_vars_all, num_vars_all);
-  quad_cost_full_ = MatrixXd::Zero(num_vars_all, num_vars_all);
+  num_vars_free_ = num_vars_all - 2*(DIFF_RULE_LENGTH-1);
+  free_start_ = DIFF_RULE_LENGTH-1;
+  quad_cost_full_band_ = MatrixXd::Zero(num_vars_all, BANDWIDTH+1);
 
-  // construct the quad cost for all variables, as a sum of squared differentiation matrices
+  // construct the quad cost for all variables, as a sum of squared differentiation matrices.
+  // Row r of a differentiation matrix has the rule centered on column r, so each row
+  // adds the outer product of the rule with itself
   double multiplier = 1.0;
   for (unsigned int i=0; i<derivative_costs.size(); i++)
   {
     multiplier *= trajectory.getDiscretization();
-    diff_matrix = getDiffMatrix(num_vars_all, &DIFF_RULES[i][0]);
-    quad_cost_full_ += (derivative_costs[i] * multiplier) *
-        (diff_matrix.transpose()*diff_matrix);
+    const double* diff_rule = &DIFF_RULES[i][0];
+    double weight = derivative_costs[i] * multiplier;
+    for (int r=0; r<num_vars_all; r++)
+    {
+      for (int p=-DIFF_RULE_LENGTH/2; p<=DIFF_RULE_LENGTH/2; p++)
+      {
+        int col_p = r+p;
+        if (col_p < 0 || col_p >= num_vars_all)
+          continue;
+        for (int q=-DIFF_RULE_LENGTH/2; q<=p; q++)
+        {
+          int col_q = r+q;
+          if (col_q < 0)
+            continue;
+          quad_cost_full_band_(col_p, col_p-col_q) += weight * diff_rule[p+DIFF_RULE_LENGTH/2] * diff_rule[q+DIFF_RULE_LENGTH/2];
+        }
+      }
+    }
   }
-  quad_cost_full_ += MatrixXd::Identity(num_vars_all, num_vars_all)*ridge_factor;
-
-  // extract the quad cost just for the free variables:
-  quad_cost_ = quad_cost_full_.block(DIFF_RULE_LENGTH-1, DIFF_RULE_LENGTH-1,
-      num_vars_free, num_vars_free);
+  quad_cost_full_band_.col(0).array() += ridge_factor;
 
-  // invert the matrix:
-  quad_cost_inv_ = quad_cost_.inverse();
-
-  //cout << quad_cost_inv_ << endl;
+  factorizeQuadCost();
 
+  boost::mutex::scoped_lock lock(cost_cache_mutex);
+  if (cost_cache.size() >= MAX_CACHED_COSTS)
+    cost_cache.clear();
+  cost_cache.insert(make_pair(key, *this));
 }
 
-Eigen::MatrixXd ChompCost::getDiffMatrix(int size, const double* diff_rule) const
+void ChompCost::factorizeQuadCost()
 {
-  MatrixXd matrix = MatrixXd::Zero(size,size);
-  for (int i=0; i<size; i++)
+  int n = num_vars_free_;
+  quad_cost_factor_band_ = MatrixXd::Zero(n, BANDWIDTH+1);
+  quad_cost_factor_diagonal_ = VectorXd::Zero(n);
+
+  // banded LDL^T of the free variable block, L has a unit diagonal that isn't stored
+  MatrixXd& L = quad_cost_factor_band_;
+  VectorXd& D = quad_cost_factor_diagonal_;
+  for (int j=0; j<n; j++)
   {
-    for (int j=-DIFF_RULE_LENGTH/2; j<=DIFF_RULE_LENGTH/2; j++)
+    double d = quad_cost_full_band_(free_start_+j, 0);
+    for (int k=max(0, j-BANDWIDTH); k<j; k++)
+      d -= L(j, j-k) * L(j, j-k) * D(k);
+    D(j) = d;
+    int end = min(n-1, j+BANDWIDTH);
+    for (int i=j+1; i<=end; i++)
     {
-      int index = i+j;
-      if (index < 0)
-        continue;
-      if (index >= size)
-        continue;
-      matrix(i,index) = diff_rule[j+DIFF_RULE_LENGTH/2];
+      double l = quad_cost_full_band_(free_start_+i, i-j);
+      for (int k=max(0, i-BANDWIDTH); k<j; k++)
+        l -= L(i, i-k) * L(j, j-k) * D(k);
+      L(i, i-j) = l / d;
     }
   }
-  return matrix;
+
+  // the diagonal of the inverse from the factorization (Takahashi et al.), which
+  // only needs the inverse's entries within the band
+  MatrixXd Z = MatrixXd::Zero(n, BANDWIDTH+1);
+  for (int i=n-1; i>=0; i--)
+  {
+    int end = min(n-1, i+BANDWIDTH);
+    for (int j=end; j>i; j--)
+    {
+      double z = 0.0;
+      for (int k=i+1; k<=end; k++)
+        z -= L(k, k-i) * ((k >= j) ? Z(k, k-j) : Z(j, j-k));
+      Z(j, j-i) = z;
+    }
+    double z = 1.0 / D(i);
+    for (int k=i+1; k<=end; k++)
+      z -= L(k, k-i) * Z(k, k-i);
+    Z(i, 0) = z;
+  }
+  quad_cost_inv_diagonal_ = Z.col(0);
+}
+
+void ChompCost::applyQuadraticCostInverse(Eigen::VectorXd& vector) const
+{
+  int n = num_vars_free_;
+  const MatrixXd& L = quad_cost_factor_band_;
+  for (int i=0; i<n; i++)
+  {
+    for (int k=max(0, i-BANDWIDTH); k<i; k++)
+      vector(i) -= L(i, i-k) * vector(k);
+  }
+  vector.array() /= quad_cost_factor_diagonal_.array();
+  for (int i=n-1; i>=0; i--)
+  {
+    int end = min(n-1, i+BANDWIDTH);
+    for (int k=i+1; k<=end; k++)
+      vector(i) -= L(k, k-i) * vector(k);
+  }
+}
+
+void ChompCost::applyQuadraticCostInverseFactor(Eigen::VectorXd& vector) const
+{
+  int n = num_vars_free_;
+  const MatrixXd& L = quad_cost_factor_band_;
+  vector.array() /= quad_cost_factor_diagonal_.array().sqrt();
+  for (int i=n-1; i>=0; i--)
+  {
+    int end = min(n-1, i+BANDWIDTH);
+    for (int k=i+1; k<=end; k++)
+      vector(i) -= L(k, k-i) * vector(k);
+  }
+}
+
+void ChompCost::getQuadraticCostInverseColumn(int index, Eigen::VectorXd& column) const
+{
+  column = VectorXd::Zero(num_vars_free_);
+  column(index) = 1.0;
+  applyQuadraticCostInverse(column);
+}
+
+Eigen::MatrixXd ChompCost::getQuadraticCostInverse() const
+{
+  MatrixXd inverse(num_vars_free_, num_vars_free_);
+  VectorXd column;
+  for (int i=0; i<num_vars_free_; i++)
+  {
+    getQuadraticCostInverseColumn(i, column);
+    inverse.col(i) = column;
+  }
+  return inverse;
+}
+
+Eigen::MatrixXd ChompCost::getQuadraticCost() const
+{
+  MatrixXd quad_cost = MatrixXd::Zero(num_vars_free_, num_vars_free_);
+  for (int i=0; i<num_vars_free_; i++)
+  {
+    int end = min(num_vars_free_-1, i+BANDWIDTH);
+    for (int j=max(0, i-BANDWIDTH); j<=end; j++)
+      quad_cost(i,j) = getFullQuadCost(free_start_+i, free_start_+j);
+  }
+  return quad_cost;
 }
 
 double ChompCost::getMaxQuadCostInvValue() const
 {
-  return quad_cost_inv_.maxCoeff();
+  // the inverse is positive definite, so no entry is larger than the largest diagonal
+  return quad_cost_inv_diagonal_.maxCoeff();
 }
 
 void ChompCost::scale(double scale)
 {
   double inv_scale = 1.0/scale;
-  quad_cost_inv_ *= inv_scale;
-  quad_cost_ *= scale;
-  quad_cost_full_ *= scale;
+  quad_cost_inv_diagonal_ *= inv_scale;
+  quad_cost_factor_diagonal_ *= scale;
+  quad_cost_full_band_ *= scale;
 }
 
 ChompCost::~ChompCost()
@@ -42,6 +42,8 @@
 #include <eigen3/Eigen/LU>
 #include <eigen3/Eigen/Core>
 #include <ros/console.h>
+#include <boost/thread.hpp>
+#include <limits>
 using namespace std;
 using namespace Eigen;
 using namespace planning_models;
@@ -61,7 +63,9 @@ namespace chomp
                                  const ros::Publisher& vis_marker_publisher, CollisionProximitySpace *collision_space) :
     full_trajectory_(trajectory), robot_model_(robot_model), planning_group_(planning_group), parameters_(parameters),
         collision_space_(collision_space), group_trajectory_(*full_trajectory_, planning_group_, DIFF_RULE_LENGTH),
-        vis_marker_array_pub_(vis_marker_array_publisher), vis_marker_pub_(vis_marker_publisher)
+        vis_marker_array_pub_(vis_marker_array_publisher), vis_marker_pub_(vis_marker_publisher),
+        momentum_gaussian_(boost::mt19937(), boost::normal_distribution<>(0.0, 1.0)),
+        worker_job_generation_(0), worker_jobs_pending_(0), workers_exiting_(false)
   {
     initialize();
   }
@@ -76,6 +80,8 @@ namespace chomp
 
     free_vars_start_ = group_trajectory_.getStartIndex();
     free_vars_end_ = group_trajectory_.getEndIndex();
+    cancelled_ = false;
+    best_group_trajectory_cost_ = numeric_limits<double>::max();
 
     vector<GradientInfo> infos;
     collision_space_->getStateGradients(infos);
@@ -125,16 +131,15 @@ namespace chomp
     collision_increments_ = MatrixXd::Zero(num_vars_free_, num_joints_);
     final_increments_ = MatrixXd::Zero(num_vars_free_, num_joints_);
     smoothness_derivative_ = VectorXd::Zero(num_vars_all_);
-    jacobian_ = MatrixXd::Zero(3, num_joints_);
-    jacobian_pseudo_inverse_ = MatrixXd::Zero(num_joints_, 3);
-    jacobian_jacobian_tranpose_ = MatrixXd::Zero(3, 3);
+    joint_increment_ = VectorXd::Zero(num_vars_free_);
     random_state_ = VectorXd::Zero(num_joints_);
     joint_state_velocities_ = VectorXd::Zero(num_joints_);
 
     group_trajectory_backup_ = group_trajectory_.getTrajectory();
     best_group_trajectory_ = group_trajectory_.getTrajectory();
 
-    collision_point_joint_names_.resize(num_vars_all_, vector<string>(num_collision_points_));
+    num_joint_mask_words_ = (num_joints_ + JOINT_MASK_WORD_BITS - 1) / JOINT_MASK_WORD_BITS;
+    collision_point_joint_masks_.resize(num_collision_points_ * num_joint_mask_words_, 0);
     collision_point_pos_eigen_.resize(num_vars_all_, vector<Vector3d>(num_collision_points_));
     collision_point_vel_eigen_.resize(num_vars_all_, vector<Vector3d>(num_collision_points_));
     collision_point_acc_eigen_.resize(num_vars_all_, vector<Vector3d>(num_collision_points_));
@@ -156,14 +161,9 @@ namespace chomp
     momentum_ = MatrixXd::Zero(num_vars_free_, num_joints_);
     random_momentum_ = MatrixXd::Zero(num_vars_free_, num_joints_);
     random_joint_momentum_ = VectorXd::Zero(num_vars_free_);
-    multivariate_gaussian_.clear();
     stochasticity_factor_ = 1.0;
-    for(int i = 0; i < num_joints_; i++)
-    {
-      multivariate_gaussian_.push_back(
-                                       MultivariateGaussian(VectorXd::Zero(num_vars_free_),
-                                                            joint_costs_[i].getQuadraticCostInverse()));
-    }
+    momentum_gaussian_.engine().seed(rand());
+    momentum_gaussian_.distribution().reset();
 
     map<string, KinematicModel::JointModelGroup*> groupMap = robot_model_->getJointModelGroupMap();
     KinematicModel::JointModelGroup* modelGroup = groupMap[planning_group_];
@@ -176,6 +176,53 @@ namespace chomp
       fixedLinkResolutionMap[joint_names_[i]] = joint_names_[i];
     }
 
+    // resolve everything the optimizer loop needs to know about the joints up front
+    joint_models_.clear();
+    joint_model_axes_.clear();
+    joint_origin_transforms_.clear();
+    joint_is_continuous_.clear();
+    joint_min_.clear();
+    joint_max_.clear();
+    for(int i = 0; i < num_joints_; i++)
+    {
+      const KinematicModel::JointModel* jointModel = modelGroup->getJointModels()[i];
+      const KinematicModel::RevoluteJointModel* revoluteJoint = dynamic_cast<const KinematicModel::RevoluteJointModel*>(jointModel);
+      const KinematicModel::PrismaticJointModel* prismaticJoint = dynamic_cast<const KinematicModel::PrismaticJointModel*>(jointModel);
+
+      tf::Vector3 axis(0.0, 0.0, 0.0);
+      if(revoluteJoint != NULL)
+      {
+        axis = revoluteJoint->axis_;
+      }
+      else if(prismaticJoint != NULL)
+      {
+        axis = prismaticJoint->axis_;
+      }
+
+      double joint_max = -10000;
+      double joint_min = 10000;
+      map<string, pair<double,double> > bounds = jointModel->getAllVariableBounds();
+      for(map<string,pair<double,double> >::iterator it = bounds.begin(); it != bounds.end(); it ++)
+      {
+        if(it->second.first < joint_min)
+        {
+          joint_min = it->second.first;
+        }
+
+        if(it->second.second > joint_max)
+        {
+          joint_max = it->second.second;
+        }
+      }
+
+      joint_models_.push_back(jointModel);
+      joint_model_axes_.push_back(axis);
+      joint_origin_transforms_.push_back(jointModel->getChildLinkModel()->getJointOriginTransform());
+      joint_is_continuous_.push_back(revoluteJoint != NULL && revoluteJoint->continuous_);
+      joint_min_.push_back(joint_min);
+      joint_max_.push_back(joint_max);
+    }
+
     for(size_t i = 0; i < modelGroup->getFixedJointModels().size(); i ++)
     {
       const KinematicModel::JointModel* model = modelGroup->getFixedJointModels()[i];
@@ -224,35 +271,75 @@ namespace chomp
       ROS_INFO("%s",ss.str().c_str());
     }
 
-    int start = free_vars_start_;
-    int end = free_vars_end_;
+    // the joints that move a collision point are the same at every timestep, so they're resolved once into a
+    // bit per group joint rather than looked up by name for every jacobian
     vector<GradientInfo> gradients;
     collision_space_->getStateGradients(gradients);
-    for(int i = start; i <= end; ++i)
+    size_t j = 0;
+    for(size_t g = 0; g < gradients.size(); g++)
     {
-      size_t j = 0;
-      for(size_t g = 0; g < gradients.size(); g++)
-      {
-        GradientInfo& info = gradients[g];
+      GradientInfo& info = gradients[g];
 
-        for(size_t k = 0; k < info.sphere_locations.size(); k++)
+      vector<uint64_t> joint_mask(num_joint_mask_words_, 0);
+      if(fixedLinkResolutionMap.find(info.joint_name) != fixedLinkResolutionMap.end())
+      {
+        const string& joint_name = fixedLinkResolutionMap[info.joint_name];
+        for(int k = 0; k < num_joints_; k++)
         {
-          if(fixedLinkResolutionMap.find(info.joint_name) != fixedLinkResolutionMap.end())
-          {
-            collision_point_joint_names_[i][j] = fixedLinkResolutionMap[info.joint_name];
-          }
-          else
+          if(isParent(joint_name, joint_names_[k]))
           {
-            ROS_ERROR("Couldn't find joint %s!", info.joint_name.c_str());
+            joint_mask[k / JOINT_MASK_WORD_BITS] |= (uint64_t(1) << (k % JOINT_MASK_WORD_BITS));
           }
-          j++;
         }
       }
+      else
+      {
+        ROS_ERROR("Couldn't find joint %s!", info.joint_name.c_str());
+      }
+
+      for(size_t k = 0; k < info.sphere_locations.size(); k++)
+      {
+        copy(joint_mask.begin(), joint_mask.end(), collision_point_joint_masks_.begin() + j * num_joint_mask_words_);
+        j++;
+      }
+    }
+
+    int num_workers = min(parameters_->getNumThreads(), num_vars_all_);
+    for(int i = 0; i < num_workers; i++)
+    {
+      KinematicState* state = new KinematicState(*robot_state_);
+      worker_states_.push_back(state);
+      worker_joint_state_groups_.push_back((KinematicState::JointStateGroup*)(state->getJointStateGroup(planning_group_)));
+      worker_joint_states_.push_back(vector<const KinematicState::JointState*>(num_joints_));
+      worker_parent_link_states_.push_back(vector<const KinematicState::LinkState*>(num_joints_));
+      for(int j = 0; j < num_joints_; j++)
+      {
+        worker_joint_states_[i][j] = state->getJointState(joint_names_[j]);
+        worker_parent_link_states_[i][j] = state->getLinkState(joint_models_[j]->getParentLinkModel()->getName());
+      }
+      worker_jacobians_.push_back(MatrixXd::Zero(3, num_joints_));
+      worker_jacobian_pseudo_inverses_.push_back(MatrixXd::Zero(num_joints_, 3));
+      worker_jacobian_jacobian_tranposes_.push_back(MatrixXd::Zero(3, 3));
+    }
+    worker_contexts_.resize(num_workers);
+    for(int i = 1; i < num_workers; i++)
+    {
+      worker_threads_.create_thread(boost::bind(&ChompOptimizer::workerThread, this, i));
     }
   }
 
   ChompOptimizer::~ChompOptimizer()
   {
+    {
+      boost::mutex::scoped_lock lock(worker_mutex_);
+      workers_exiting_ = true;
+    }
+    worker_job_condition_.notify_all();
+    worker_threads_.join_all();
+    for(size_t i = 0; i < worker_states_.size(); i++)
+    {
+      delete worker_states_[i];
+    }
     destroy();
   }
 
@@ -291,6 +378,11 @@ namespace chomp
   void ChompOptimizer::optimize()
   {
     ros::WallTime start_time = ros::WallTime::now();
+    ros::WallTime phase_time;
+    report_ = chomp_motion_planner::ChompOptimizationReport();
+    report_.costs.reserve(parameters_->getMaxIterations());
+    report_.smoothness_costs.reserve(parameters_->getMaxIterations());
+    report_.collision_costs.reserve(parameters_->getMaxIterations());
     double averageCostVelocity = 0.0;
     int currentCostIter = 0;
     int costWindow = 10;
@@ -306,12 +398,24 @@ namespace chomp
     // iterate
     for(iteration_ = 0; iteration_ < parameters_->getMaxIterations(); iteration_++)
     {
-      ros::WallTime for_time = ros::WallTime::now();
+      if(isCancelled())
+      {
+        ROS_INFO("Optimization cancelled at iteration %d", iteration_);
+        break;
+      }
+
+      phase_time = ros::WallTime::now();
       performForwardKinematics();
-      ROS_DEBUG_STREAM("Forward kinematics took " << (ros::WallTime::now()-for_time));
+      report_.forward_kinematics_time += (ros::WallTime::now() - phase_time).toSec();
+
+      phase_time = ros::WallTime::now();
       double cCost = getCollisionCost();
       double sCost = getSmoothnessCost();
       double cost = cCost + sCost;
+      report_.cost_time += (ros::WallTime::now() - phase_time).toSec();
+      report_.costs.push_back(cost);
+      report_.smoothness_costs.push_back(sCost);
+      report_.collision_costs.push_back(cCost);
 
       if(parameters_->getAddRandomness() && currentCostIter != -1)
       {
@@ -343,12 +447,19 @@ namespace chomp
           last_improvement_iteration_ = iteration_;
         }
       }
+      phase_time = ros::WallTime::now();
       calculateSmoothnessIncrements();
-      ros::WallTime coll_time = ros::WallTime::now();
+      report_.smoothness_increments_time += (ros::WallTime::now() - phase_time).toSec();
+
+      phase_time = ros::WallTime::now();
       calculateCollisionIncrements();
-      ROS_DEBUG_STREAM("Collision increments took " << (ros::WallTime::now()-coll_time));
+      report_.collision_increments_time += (ros::WallTime::now() - phase_time).toSec();
+
+      phase_time = ros::WallTime::now();
       calculateTotalIncrements();
+      report_.total_increments_time += (ros::WallTime::now() - phase_time).toSec();
 
+      phase_time = ros::WallTime::now();
       if(!parameters_->getUseHamiltonianMonteCarlo())
       {
         // non-stochastic version:
@@ -362,7 +473,11 @@ namespace chomp
         updatePositionFromMomentum();
         stochasticity_factor_ *= parameters_->getHmcAnnealingFactor();
       }
+      report_.trajectory_update_time += (ros::WallTime::now() - phase_time).toSec();
+
+      phase_time = ros::WallTime::now();
       handleJointLimits();
+      report_.joint_limits_time += (ros::WallTime::now() - phase_time).toSec();
       updateFullTrajectory();
 
       if(iteration_ % 10 == 0)
@@ -409,6 +524,7 @@ namespace chomp
       if(fabs(averageCostVelocity) < minimaThreshold && currentCostIter == -1 && !is_collision_free_ && parameters_->getAddRandomness())
       {
         ROS_INFO("Detected local minima. Attempting to break out!");
+        phase_time = ros::WallTime::now();
         int iter = 0;
         bool success = false;
         while(iter < 20 && !success)
@@ -444,6 +560,7 @@ namespace chomp
         {
           ROS_INFO("Failed to exit minimum!");
         }
+        report_.local_minima_time += (ros::WallTime::now() - phase_time).toSec();
       }
       else if(currentCostIter == -1)
       {
@@ -498,13 +615,32 @@ namespace chomp
     if(parameters_->getAnimatePath())
       animatePath();
 
+    report_.iterations = iteration_;
+    report_.best_iteration = last_improvement_iteration_;
+    report_.collision_free = is_collision_free_;
+    report_.cancelled = isCancelled();
+    report_.total_time = (ros::WallTime::now() - start_time).toSec();
+
     ROS_INFO("Terminated after %d iterations, using path from iteration %d", iteration_, last_improvement_iteration_);
     ROS_INFO("Optimization core finished in %f sec", (ros::WallTime::now() - start_time).toSec() );
     ROS_INFO_STREAM("Time per iteration " << (ros::WallTime::now() - start_time).toSec()/(iteration_*1.0));
   }
 
+  void ChompOptimizer::cancel()
+  {
+    boost::mutex::scoped_lock lock(cancel_mutex_);
+    cancelled_ = true;
+  }
+
+  bool ChompOptimizer::isCancelled() const
+  {
+    boost::mutex::scoped_lock lock(cancel_mutex_);
+    return cancelled_;
+  }
+
 CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidity()
 {
+    ros::WallTime check_time = ros::WallTime::now();
     JointTrajectory jointTrajectory;
     jointTrajectory.joint_names = joint_names_;
     jointTrajectory.header.frame_id = collision_space_->getCollisionModelsInterface()->getRobotFrameId();
@@ -523,7 +659,10 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
       jointTrajectory.points.push_back(point);
     }
 
-    return collision_space_->isTrajectorySafe(jointTrajectory, goalConstraints, pathConstraints, planning_group_);
+    CollisionProximitySpace::TrajectorySafety safety = collision_space_->isTrajectorySafe(jointTrajectory, goalConstraints,
+                                                                                          pathConstraints, planning_group_);
+    report_.validity_check_time += (ros::WallTime::now() - check_time).toSec();
+    return safety;
     /*
     bool valid = collision_space_->getCollisionModelsInterface()->isJointTrajectoryValid(*robot_state_,
                                                                                          jointTrajectory,
@@ -546,16 +685,6 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
 
   void ChompOptimizer::calculateCollisionIncrements()
   {
-    double potential;
-    double vel_mag_sq;
-    double vel_mag;
-    Vector3d potential_gradient;
-    Vector3d normalized_velocity;
-    Matrix3d orthogonal_projector;
-    Vector3d curvature_vector;
-    Vector3d cartesian_gradient;
-
-
     collision_increments_.setZero(num_vars_free_, num_joints_);
 
     int startPoint = 0;
@@ -575,7 +704,83 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
       startPoint = free_vars_start_;
     }
 
-    for(int i = startPoint; i <= endPoint; i++)
+    // each point only writes its own row of the increments, and always sums its collision points in the
+    // same order, so the result doesn't depend on the number of workers
+    int num_workers = worker_states_.size();
+    if(num_workers > 1 && endPoint > startPoint)
+    {
+      runWorkers(boost::bind(&ChompOptimizer::calculateCollisionIncrements, this, _1, num_workers,
+                             startPoint, endPoint));
+    }
+    else
+    {
+      calculateCollisionIncrements(0, 1, startPoint, endPoint);
+    }
+    //cout << collision_increments_ << endl;
+  }
+
+  void ChompOptimizer::runWorkers(const boost::function<void (int)>& job)
+  {
+    {
+      boost::mutex::scoped_lock lock(worker_mutex_);
+      worker_job_ = job;
+      worker_jobs_pending_ = worker_states_.size() - 1;
+      worker_job_generation_++;
+    }
+    worker_job_condition_.notify_all();
+    job(0);
+
+    boost::mutex::scoped_lock lock(worker_mutex_);
+    while(worker_jobs_pending_ > 0)
+    {
+      worker_done_condition_.wait(lock);
+    }
+  }
+
+  void ChompOptimizer::workerThread(int worker)
+  {
+    unsigned int generation = 0;
+    while(true)
+    {
+      boost::function<void (int)> job;
+      {
+        boost::mutex::scoped_lock lock(worker_mutex_);
+        while(!workers_exiting_ && worker_job_generation_ == generation)
+        {
+          worker_job_condition_.wait(lock);
+        }
+        if(workers_exiting_)
+        {
+          return;
+        }
+        generation = worker_job_generation_;
+        job = worker_job_;
+      }
+      job(worker);
+      {
+        boost::mutex::scoped_lock lock(worker_mutex_);
+        worker_jobs_pending_--;
+      }
+      worker_done_condition_.notify_one();
+    }
+  }
+
+  void ChompOptimizer::calculateCollisionIncrements(int worker, int num_workers, int start, int end)
+  {
+    double potential;
+    double vel_mag_sq;
+    double vel_mag;
+    Vector3d potential_gradient;
+    Vector3d normalized_velocity;
+    Matrix3d orthogonal_projector;
+    Vector3d curvature_vector;
+    Vector3d cartesian_gradient;
+
+    MatrixXd& jacobian = worker_jacobians_[worker];
+    MatrixXd& jacobian_pseudo_inverse = worker_jacobian_pseudo_inverses_[worker];
+    MatrixXd& jacobian_jacobian_tranpose = worker_jacobian_jacobian_tranposes_[worker];
+
+    for(int i = start + worker; i <= end; i += num_workers)
     {
       for(int j = 0; j < num_collision_points_; j++)
       {
@@ -597,16 +802,16 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
         cartesian_gradient = vel_mag * (orthogonal_projector * potential_gradient - potential * curvature_vector);
 
         // pass it through the jacobian transpose to get the increments
-        getJacobian(i, collision_point_pos_eigen_[i][j], collision_point_joint_names_[i][j] ,jacobian_);
+        getJacobian(i, collision_point_pos_eigen_[i][j], &collision_point_joint_masks_[j * num_joint_mask_words_], jacobian);
 
         if(parameters_->getUsePseudoInverse())
         {
-          calculatePseudoInverse();
-          collision_increments_.row(i - free_vars_start_).transpose() -= jacobian_pseudo_inverse_ * cartesian_gradient;
+          calculatePseudoInverse(jacobian, jacobian_jacobian_tranpose, jacobian_pseudo_inverse);
+          collision_increments_.row(i - free_vars_start_).transpose() -= jacobian_pseudo_inverse * cartesian_gradient;
         }
         else
         {
-          collision_increments_.row(i - free_vars_start_).transpose() -= jacobian_.transpose() * cartesian_gradient;
+          collision_increments_.row(i - free_vars_start_).transpose() -= jacobian.transpose() * cartesian_gradient;
         }
 
         /*
@@ -617,35 +822,31 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
         */
       }
     }
-    //cout << collision_increments_ << endl;
   }
 
-  void ChompOptimizer::calculatePseudoInverse()
+  void ChompOptimizer::calculatePseudoInverse(const MatrixXd& jacobian, MatrixXd& jacobian_jacobian_tranpose,
+                                              MatrixXd& jacobian_pseudo_inverse) const
   {
-    jacobian_jacobian_tranpose_ = jacobian_ * jacobian_.transpose() + MatrixXd::Identity(3, 3)
+    jacobian_jacobian_tranpose = jacobian * jacobian.transpose() + MatrixXd::Identity(3, 3)
         * parameters_->getPseudoInverseRidgeFactor();
-    jacobian_pseudo_inverse_ = jacobian_.transpose() * jacobian_jacobian_tranpose_.inverse();
+    jacobian_pseudo_inverse = jacobian.transpose() * jacobian_jacobian_tranpose.inverse();
   }
 
   void ChompOptimizer::calculateTotalIncrements()
   {
     for(int i = 0; i < num_joints_; i++)
     {
-      final_increments_.col(i) = parameters_->getLearningRate() * (joint_costs_[i].getQuadraticCostInverse()
-          * (parameters_->getSmoothnessCostWeight() * smoothness_increments_.col(i)
-              + parameters_->getObstacleCostWeight() * collision_increments_.col(i)));
+      joint_increment_ = parameters_->getSmoothnessCostWeight() * smoothness_increments_.col(i)
+          + parameters_->getObstacleCostWeight() * collision_increments_.col(i);
+      joint_costs_[i].applyQuadraticCostInverse(joint_increment_);
+      final_increments_.col(i) = parameters_->getLearningRate() * joint_increment_;
     }
 
   }
 
   void ChompOptimizer::addIncrementsToTrajectory()
   {
-    map<string, KinematicModel::JointModelGroup*> modelGroups = robot_model_->getJointModelGroupMap();
-    string group = planning_group_;
-    const KinematicModel::JointModelGroup* modelGroup = modelGroups[group];
-    const vector<const KinematicModel::JointModel*>& jointModels = modelGroup->getJointModels();
-
-    for(size_t i = 0; i < jointModels.size(); i++)
+    for(int i = 0; i < num_joints_; i++)
     {
       double scale = 1.0;
       double max = final_increments_.col(i).maxCoeff();
@@ -716,52 +917,33 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
     return parameters_->getObstacleCostWeight() * collision_cost;
   }
 
-  void ChompOptimizer::computeJointProperties(int trajectoryPoint)
+  void ChompOptimizer::computeJointProperties(int trajectoryPoint, int worker)
   {
-    tf::Transform inverseWorldTransform = collision_space_->getInverseWorldTransform(*robot_state_);
+    const KinematicState* state = worker_states_[worker];
+    const vector<const KinematicState::JointState*>& jointStates = worker_joint_states_[worker];
+    const vector<const KinematicState::LinkState*>& parentLinkStates = worker_parent_link_states_[worker];
+
+    tf::Transform inverseWorldTransform = collision_space_->getInverseWorldTransform(*state);
      for(int j = 0; j < num_joints_; j++)
      {
-       string jointName = joint_names_[j];
-       const KinematicState::JointState* jointState = robot_state_->getJointState(jointName);
-       const KinematicModel::JointModel* jointModel = jointState->getJointModel();
-       const KinematicModel::RevoluteJointModel* revoluteJoint = dynamic_cast<const KinematicModel::RevoluteJointModel*>(jointModel);
-       const KinematicModel::PrismaticJointModel* prismaticJoint = dynamic_cast<const KinematicModel::PrismaticJointModel*>(jointModel);
-
-       string parentLinkName = jointModel->getParentLinkModel()->getName();
-       string childLinkName = jointModel->getChildLinkModel()->getName();
        tf::Transform jointTransform =
-           robot_state_->getLinkState(parentLinkName)->getGlobalLinkTransform()
-           * (robot_model_->getLinkModel(childLinkName)->getJointOriginTransform()
-               * (robot_state_->getJointState(jointModel->getName())->getVariableTransform()));
-
+           parentLinkStates[j]->getGlobalLinkTransform()
+           * (joint_origin_transforms_[j] * jointStates[j]->getVariableTransform());
 
        jointTransform = inverseWorldTransform * jointTransform;
-       tf::Vector3 axis;
-
-
-       if(revoluteJoint != NULL)
-       {
-         axis = revoluteJoint->axis_;
-       }
-       else if(prismaticJoint != NULL)
-       {
-         axis = prismaticJoint->axis_;
-       }
 
-       axis = jointTransform * axis;
-
-       joint_axes_[trajectoryPoint][j] = axis;
+       joint_axes_[trajectoryPoint][j] = jointTransform * joint_model_axes_[j];
        joint_positions_[trajectoryPoint][j] = jointTransform.getOrigin();
      }
   }
 
   template<typename Derived>
-  void ChompOptimizer::getJacobian(int trajectoryPoint, Vector3d& collision_point_pos, string& jointName,
+  void ChompOptimizer::getJacobian(int trajectoryPoint, Vector3d& collision_point_pos, const uint64_t* joint_mask,
                                    MatrixBase<Derived>& jacobian) const
   {
     for(int j = 0; j < num_joints_; j++)
     {
-      if(isParent(jointName, joint_names_[j]))
+      if((joint_mask[j / JOINT_MASK_WORD_BITS] >> (j % JOINT_MASK_WORD_BITS)) & 1)
       {
         tf::Vector3 column = joint_axes_[trajectoryPoint][j].cross(tf::Vector3(collision_point_pos(0),
                                                                            collision_point_pos(1),
@@ -783,38 +965,15 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
 
   void ChompOptimizer::handleJointLimits()
   {
-    map<string, KinematicModel::JointModelGroup*> modelGroups = robot_model_->getJointModelGroupMap();
-    string group = planning_group_;
-    KinematicModel::JointModelGroup* modelGroup = modelGroups[group];
-
     for(int joint = 0; joint < num_joints_; joint++)
     {
-      const string& jointName = joint_names_[joint];
-      const KinematicModel::JointModel* jointModel = modelGroup->getJointModel(jointName);
-      const KinematicModel::RevoluteJointModel* revoluteJoint = dynamic_cast<const KinematicModel::RevoluteJointModel*>(jointModel);
-
-      if(revoluteJoint->continuous_)
+      if(joint_is_continuous_[joint])
       {
         continue;
       }
-      map<string, pair<double,double> > bounds = jointModel->getAllVariableBounds();
-
-      double joint_max = -10000;
-      double joint_min = 10000;
-
-      for(map<string,pair<double,double> >::iterator it = bounds.begin(); it != bounds.end(); it ++)
-      {
-        if(it->second.first < joint_min)
-        {
-          joint_min = it->second.first;
-        }
-
-        if(it->second.second > joint_max)
-        {
-          joint_max = it->second.second;
-        }
-      }
 
+      double joint_max = joint_max_[joint];
+      double joint_min = joint_min_[joint];
 
       int count = 0;
 
@@ -851,10 +1010,9 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
         if(violation)
         {
           int free_var_index = max_violation_index - free_vars_start_;
-          double multiplier = max_violation / joint_costs_[joint].getQuadraticCostInverse()(free_var_index,
-                                                                                            free_var_index);
-          group_trajectory_.getFreeJointTrajectoryBlock(joint) += multiplier
-              * joint_costs_[joint].getQuadraticCostInverse().col(free_var_index);
+          double multiplier = max_violation / joint_costs_[joint].getQuadraticCostInverseDiagonal(free_var_index);
+          joint_costs_[joint].getQuadraticCostInverseColumn(free_var_index, joint_increment_);
+          group_trajectory_.getFreeJointTrajectoryBlock(joint) += multiplier * joint_increment_;
         }
         if(++count > 10)
           break;
@@ -877,18 +1035,64 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
       end = num_vars_all_ - 1;
     }
 
-    is_collision_free_ = true;
+    // the points are independent, so they're split between workers with their own state copies
+    int num_workers = worker_states_.size();
+    if(num_workers > 1)
+    {
+      runWorkers(boost::bind(&ChompOptimizer::performForwardKinematics, this, _1, start, end));
+    }
+    else
+    {
+      performForwardKinematics(0, start, end);
+    }
 
-    // for each point in the trajectory
+    is_collision_free_ = true;
     for(int i = start; i <= end; ++i)
+    {
+      if(state_is_in_collision_[i])
+      {
+        is_collision_free_ = false;
+      }
+    }
+
+    // now, get the vel and acc for each collision point (using finite differencing)
+    for(int i = free_vars_start_; i <= free_vars_end_; i++)
+    {
+      for(int j = 0; j < num_collision_points_; j++)
+      {
+        collision_point_vel_eigen_[i][j] = Vector3d(0,0,0);
+        collision_point_acc_eigen_[i][j] = Vector3d(0,0,0);
+        for(int k = -DIFF_RULE_LENGTH / 2; k <= DIFF_RULE_LENGTH / 2; k++)
+        {
+          collision_point_vel_eigen_[i][j] += (invTime * DIFF_RULES[0][k + DIFF_RULE_LENGTH / 2]) * collision_point_pos_eigen_[i
+              + k][j];
+          collision_point_acc_eigen_[i][j] += (invTimeSq * DIFF_RULES[1][k + DIFF_RULE_LENGTH / 2]) * collision_point_pos_eigen_[i
+              + k][j];
+        }
+
+        // get the norm of the velocity:
+        collision_point_vel_mag_[i][j] = collision_point_vel_eigen_[i][j].norm();
+      }
+    }
+  }
+
+  void ChompOptimizer::performForwardKinematics(int worker, int start, int end)
+  {
+    KinematicState* state = worker_states_[worker];
+    CollisionProximitySpace::GroupStateContext& context = worker_contexts_[worker];
+    int num_workers = worker_states_.size();
+    vector<GradientInfo> gradients;
+
+    // every num_workers'th point, so the workers see the same mix of free and colliding states
+    for(int i = start + worker; i <= end; i += num_workers)
     {
       // Set Robot state from trajectory point...
-      setRobotStateFromPoint(group_trajectory_, i);
-      computeJointProperties(i);
+      setRobotStateFromPoint(group_trajectory_, i, worker);
+      computeJointProperties(i, worker);
+      collision_space_->setGroupStateContext(*state, context);
       state_is_in_collision_[i] = false;
 
-      vector<GradientInfo> gradients;
-      collision_space_->getStateGradients(gradients);
+      collision_space_->getStateGradients(context, gradients);
       //Keep vars in scope
       {
         size_t j = 0;
@@ -912,36 +1116,15 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
             if(point_is_in_collision_[i][j])
             {
               state_is_in_collision_[i] = true;
-              is_collision_free_ = false;
             }
             j ++;
           }
         }
       }
     }
-
-    // now, get the vel and acc for each collision point (using finite differencing)
-    for(int i = free_vars_start_; i <= free_vars_end_; i++)
-    {
-      for(int j = 0; j < num_collision_points_; j++)
-      {
-        collision_point_vel_eigen_[i][j] = Vector3d(0,0,0);
-        collision_point_acc_eigen_[i][j] = Vector3d(0,0,0);
-        for(int k = -DIFF_RULE_LENGTH / 2; k <= DIFF_RULE_LENGTH / 2; k++)
-        {
-          collision_point_vel_eigen_[i][j] += (invTime * DIFF_RULES[0][k + DIFF_RULE_LENGTH / 2]) * collision_point_pos_eigen_[i
-              + k][j];
-          collision_point_acc_eigen_[i][j] += (invTimeSq * DIFF_RULES[1][k + DIFF_RULE_LENGTH / 2]) * collision_point_pos_eigen_[i
-              + k][j];
-        }
-
-        // get the norm of the velocity:
-        collision_point_vel_mag_[i][j] = collision_point_vel_eigen_[i][j].norm();
-      }
-    }
   }
 
-  void ChompOptimizer::setRobotStateFromPoint(ChompTrajectory& group_trajectory, int i)
+  void ChompOptimizer::setRobotStateFromPoint(ChompTrajectory& group_trajectory, int i, int worker)
   {
     const MatrixXd::RowXpr& point = group_trajectory.getTrajectoryPoint(i);
 
@@ -951,11 +1134,7 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
       jointStates.push_back(point(0,j));
     }
 
-    ros::WallTime timer = ros::WallTime::now();
-    KinematicState::JointStateGroup* group = (KinematicState::JointStateGroup*)(robot_state_->getJointStateGroup(planning_group_));
-    group->setKinematicState(jointStates);
-    timer = ros::WallTime::now();
-    collision_space_->setCurrentGroupState(*robot_state_);
+    worker_joint_state_groups_[worker]->setKinematicState(jointStates);
   }
 
   void ChompOptimizer::perturbTrajectory()
@@ -964,7 +1143,8 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
     if(worst_collision_cost_state_ < 0)
       return;
     int mid_point = worst_collision_cost_state_;
-    getRandomState(robot_state_, planning_group_, random_state_);
+    // the planning scene state may be in use by other optimizers, so the random state is based on our own copy
+    getRandomState(worker_states_[0], planning_group_, random_state_);
 
     // convert the state into an increment
     random_state_ -= group_trajectory_.getTrajectoryPoint(mid_point).transpose();
@@ -978,8 +1158,8 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
     int mp_free_vars_index = mid_point - free_vars_start_;
     for(int i = 0; i < num_joints_; i++)
     {
-      group_trajectory_.getFreeJointTrajectoryBlock(i)
-          += joint_costs_[i].getQuadraticCostInverse().col(mp_free_vars_index) * random_state_(i);
+      joint_costs_[i].getQuadraticCostInverseColumn(mp_free_vars_index, joint_increment_);
+      group_trajectory_.getFreeJointTrajectoryBlock(i) += joint_increment_ * random_state_(i);
     }
   }
 
@@ -1031,11 +1211,17 @@ CollisionProximitySpace::TrajectorySafety ChompOptimizer::checkCurrentIterValidi
     if(is_collision_free_)
       random_momentum_.setZero(num_vars_free_, num_joints_);
     else
+    {
       for(int i = 0; i < num_joints_; ++i)
       {
-        multivariate_gaussian_[i].sample(random_joint_momentum_);
+        for(int j = 0; j < num_vars_free_; j++)
+        {
+          random_joint_momentum_(j) = momentum_gaussian_();
+        }
+        joint_costs_[i].applyQuadraticCostInverseFactor(random_joint_momentum_);
         random_momentum_.col(i) = stochasticity_factor_ * random_joint_momentum_;
       }
+    }
   }
 
   void ChompOptimizer::updateMomentum()
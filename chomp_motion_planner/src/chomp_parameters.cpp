@@ -35,6 +35,7 @@
 /** \author Mrinal Kalakrishnan */
 
 #include <chomp_motion_planner/chomp_parameters.h>
+#include <algorithm>
 
 namespace chomp
 {
@@ -75,6 +76,8 @@ void ChompParameters::initFromNodeHandle()
   node_handle.param("collision_threshold", collision_threshold_, 0.07);
   node_handle.param("random_jump_amount", random_jump_amount_, 1.0);
   node_handle.param("use_stochastic_descent", use_stochastic_descent_, true);
+  node_handle.param("num_threads", num_threads_, 1);
+  num_threads_ = std::max(num_threads_, 1);
   filter_mode_ = false;
 }
 
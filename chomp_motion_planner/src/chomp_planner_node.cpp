@@ -46,7 +46,9 @@
 #include <arm_navigation_msgs/FilterJointTrajectory.h>
 #include <planning_environment/models/model_utils.h>
 #include <spline_smoother/fritsch_butland_spline_smoother.h>
+#include <boost/thread.hpp>
 
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <string>
@@ -72,6 +74,20 @@ bool ChompPlannerNode::init()
   node_handle_.param("use_additional_trajectory_filter", use_trajectory_filter_, false);
   node_handle_.param("minimum_spline_points", minimum_spline_points_, 40);
   node_handle_.param("maximum_spline_points", maximum_spline_points_, 100);
+  node_handle_.param("num_planning_starts", num_planning_starts_, 1);
+  num_planning_starts_ = max(num_planning_starts_, 1);
+
+  int trajectory_library_size;
+  double trajectory_library_max_distance;
+  node_handle_.param("use_trajectory_library", use_trajectory_library_, false);
+  node_handle_.param("trajectory_library_size", trajectory_library_size, 100);
+  node_handle_.param("trajectory_library_max_distance", trajectory_library_max_distance, 0.5);
+  node_handle_.param("trajectory_library_file", trajectory_library_file_, string(""));
+  trajectory_library_.setParameters(max(trajectory_library_size, 0), trajectory_library_max_distance);
+  if(use_trajectory_library_ && !trajectory_library_file_.empty())
+  {
+    trajectory_library_.load(trajectory_library_file_);
+  }
   if(node_handle_.hasParam("joint_velocity_limits")) {
     XmlRpc::XmlRpcValue velocity_limits;
     
@@ -114,6 +130,7 @@ bool ChompPlannerNode::init()
   // initialize the visualization publisher:
   vis_marker_array_publisher_ = root_handle_.advertise<visualization_msgs::MarkerArray>( "visualization_marker_array", 0 );
   vis_marker_publisher_ = root_handle_.advertise<visualization_msgs::Marker>( "visualization_marker", 0 );
+  optimization_report_publisher_ = root_handle_.advertise<chomp_motion_planner::ChompOptimizationReport>("chomp_planner_longrange/optimization_report", 10);
 
   // advertise the planning service
   plan_kinematic_path_service_ = root_handle_.advertiseService("chomp_planner_longrange/plan_path", &ChompPlannerNode::planKinematicPath, this);
@@ -133,6 +150,10 @@ bool ChompPlannerNode::init()
 
 ChompPlannerNode::~ChompPlannerNode()
 {
+  if(use_trajectory_library_ && !trajectory_library_file_.empty())
+  {
+    trajectory_library_.save(trajectory_library_file_);
+  }
   delete collision_models_;
 }
 
@@ -202,6 +223,7 @@ bool ChompPlannerNode::planKinematicPath(arm_navigation_msgs::GetMotionPlan::Req
 
 
   // fix the goal to move the shortest angular distance for wrap-around joints:
+  vector<bool> continuous_joints(modelGroup->getJointModels().size(), false);
   for (size_t i = 0; i < modelGroup->getJointModels().size(); i++)
   {
     const KinematicModel::JointModel* model = modelGroup->getJointModels()[i];
@@ -214,6 +236,7 @@ bool ChompPlannerNode::planKinematicPath(arm_navigation_msgs::GetMotionPlan::Req
         double start = (trajectory)(0, i);
         double end = (trajectory)(goal_index, i);
         (trajectory)(goal_index, i) = start + angles::shortest_angular_distance(start, end);
+        continuous_joints[i] = true;
       }
     }
   }
@@ -224,13 +247,81 @@ bool ChompPlannerNode::planKinematicPath(arm_navigation_msgs::GetMotionPlan::Req
   // set the max planning time:
   chomp_parameters_.setPlanningTimeLimit(req.motion_plan_request.allowed_planning_time.toSec());
 
+  // start from the closest solved request if it's close enough, then min jerk, then random detours
+  Eigen::MatrixXd library_trajectory;
+  if(use_trajectory_library_)
+  {
+    trajectory_library_.setContinuousJoints(group_name, continuous_joints);
+  }
+  bool use_library_trajectory = use_trajectory_library_ &&
+      trajectory_library_.getInitialTrajectory(group_name, trajectory.getTrajectoryPoint(0).transpose(),
+                                               trajectory.getTrajectoryPoint(goal_index).transpose(),
+                                               trajectory.getNumPoints(), library_trajectory);
+  int num_fixed_starts = use_library_trajectory ? 2 : 1;
+
   // optimize!
+  // the optimizers are created here rather than on their threads, as creating one queries the planning scene state
   ros::WallTime create_time = ros::WallTime::now();
-  ChompOptimizer optimizer(&trajectory, robot_model_, group_name, &chomp_parameters_,
-      vis_marker_array_publisher_, vis_marker_publisher_, collision_proximity_space_);
+  vector<ChompTrajectory*> trajectories;
+  vector<ChompOptimizer*> optimizers;
+  for(int i = 0; i < num_planning_starts_; i++)
+  {
+    trajectories.push_back(new ChompTrajectory(trajectory));
+    if(use_library_trajectory && i == 0)
+    {
+      trajectories[i]->getTrajectory() = library_trajectory;
+    }
+    else if(i >= num_fixed_starts)
+    {
+      addRandomViaPoint(*trajectories[i]);
+    }
+    optimizers.push_back(new ChompOptimizer(trajectories[i], robot_model_, group_name, &chomp_parameters_,
+                                            vis_marker_array_publisher_, vis_marker_publisher_, collision_proximity_space_));
+  }
   ROS_INFO("Optimization took %f sec to create", (ros::WallTime::now() - create_time).toSec());
-  optimizer.optimize();
+
+  multi_start_winner_ = -1;
+  if(num_planning_starts_ > 1)
+  {
+    boost::thread_group starts;
+    for(int i = 0; i < num_planning_starts_; i++)
+    {
+      starts.create_thread(boost::bind(&ChompPlannerNode::runOptimizer, this, i, boost::cref(optimizers)));
+    }
+    starts.join_all();
+  }
+  else
+  {
+    runOptimizer(0, optimizers);
+  }
   ROS_INFO("Optimization actually took %f sec to run", (ros::WallTime::now() - create_time).toSec());
+
+  // take the first collision free result, or the cheapest one if none got there in time
+  int best = multi_start_winner_;
+  if(best < 0)
+  {
+    best = 0;
+    for(int i = 1; i < num_planning_starts_; i++)
+    {
+      if(optimizers[i]->getBestTrajectoryCost() < optimizers[best]->getBestTrajectoryCost())
+      {
+        best = i;
+      }
+    }
+  }
+  ROS_INFO("Using the trajectory from start %d of %d", best, num_planning_starts_);
+  trajectory.getTrajectory() = trajectories[best]->getTrajectory();
+  if(use_trajectory_library_ && optimizers[best]->isCollisionFree())
+  {
+    trajectory_library_.addTrajectory(group_name, trajectory.getTrajectory());
+  }
+
+  for(int i = 0; i < num_planning_starts_; i++)
+  {
+    publishOptimizationReport(*optimizers[i], group_name, i, i == best);
+    delete optimizers[i];
+    delete trajectories[i];
+  }
   create_time = ros::WallTime::now();
   // assume that the trajectory is now optimized, fill in the output structure:
 
@@ -273,6 +364,60 @@ bool ChompPlannerNode::planKinematicPath(arm_navigation_msgs::GetMotionPlan::Req
   return true;
 }
 
+void ChompPlannerNode::addRandomViaPoint(ChompTrajectory& trajectory)
+{
+  int goal_index = trajectory.getNumPoints() - 1;
+
+  // the detour peaks halfway along and has zero velocity at the ends
+  double jump = chomp_parameters_.getRandomJumpAmount();
+  Eigen::RowVectorXd via_offset(trajectory.getNumJoints());
+  for(int j = 0; j < trajectory.getNumJoints(); j++)
+  {
+    via_offset(j) = jump * (2.0 * ((double)random() / (double)RAND_MAX) - 1.0);
+  }
+  for(int i = 1; i < goal_index; i++)
+  {
+    double bump = sin(M_PI * double(i) / double(goal_index));
+    trajectory.getTrajectoryPoint(i) += (bump * bump) * via_offset;
+  }
+}
+
+void ChompPlannerNode::runOptimizer(int start, const vector<ChompOptimizer*>& optimizers)
+{
+  optimizers[start]->optimize();
+  if(!optimizers[start]->isCollisionFree())
+  {
+    return;
+  }
+
+  boost::mutex::scoped_lock lock(multi_start_mutex_);
+  if(multi_start_winner_ >= 0)
+  {
+    return;
+  }
+  multi_start_winner_ = start;
+  for(size_t i = 0; i < optimizers.size(); i++)
+  {
+    if((int)i != start)
+    {
+      optimizers[i]->cancel();
+    }
+  }
+}
+
+void ChompPlannerNode::publishOptimizationReport(const ChompOptimizer& optimizer, const string& group_name, int start, bool selected)
+{
+  chomp_motion_planner::ChompOptimizationReport report = optimizer.getReport();
+  report.header.stamp = ros::Time::now();
+  report.group_name = group_name;
+  report.start = start;
+  report.selected = selected;
+  ROS_DEBUG("Start %d: %d iterations in %f sec (fk %f, collision %f, validity %f)", start, report.iterations,
+            report.total_time, report.forward_kinematics_time, report.collision_increments_time,
+            report.validity_check_time);
+  optimization_report_publisher_.publish(report);
+}
+
 bool ChompPlannerNode::filterJointTrajectory(arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request &request, arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Response &res)
 {
   arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request req = request;
@@ -401,6 +546,7 @@ bool ChompPlannerNode::filterJointTrajectory(arm_navigation_msgs::FilterJointTra
   ChompOptimizer optimizer(&trajectory, robot_model_, group_name, &chomp_parameters_,
       vis_marker_array_publisher_, vis_marker_publisher_, collision_proximity_space_);
   optimizer.optimize();
+  publishOptimizationReport(optimizer, group_name, 0, true);
   
   // assume that the trajectory is now optimized, fill in the output structure:
 
@@ -0,0 +1,423 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/** \author Mrinal Kalakrishnan */
+
+#include <chomp_motion_planner/trajectory_library.h>
+#include <ros/console.h>
+#include <angles/angles.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <limits>
+
+using namespace Eigen;
+using namespace std;
+
+namespace chomp
+{
+
+// stored trajectories whose endpoints are this close to a new one's are replaced by it
+static const double DUPLICATE_DISTANCE = 1e-3;
+static const string LIBRARY_FILE_HEADER = "chomp_trajectory_library";
+static const int LIBRARY_FILE_VERSION = 1;
+
+namespace
+{
+
+struct CompareKeys
+{
+  CompareKeys(const vector<VectorXd>& keys, int dimension) : keys_(keys), dimension_(dimension)
+  {
+  }
+
+  bool operator()(int a, int b) const
+  {
+    return keys_[a](dimension_) < keys_[b](dimension_);
+  }
+
+  const vector<VectorXd>& keys_;
+  int dimension_;
+};
+
+}
+
+TrajectoryLibrary::TrajectoryLibrary() : max_size_(100), max_distance_(0.5)
+{
+}
+
+TrajectoryLibrary::~TrajectoryLibrary()
+{
+}
+
+void TrajectoryLibrary::setParameters(unsigned int max_size, double max_distance)
+{
+  max_size_ = max_size;
+  max_distance_ = max_distance;
+  for (map<string, GroupLibrary>::iterator it = groups_.begin(); it != groups_.end(); it++)
+  {
+    GroupLibrary& group = it->second;
+    if (group.keys.size() > max_size_)
+    {
+      int excess = group.keys.size() - max_size_;
+      group.keys.erase(group.keys.begin(), group.keys.begin() + excess);
+      group.trajectories.erase(group.trajectories.begin(), group.trajectories.begin() + excess);
+      group.tree_valid = false;
+    }
+  }
+}
+
+void TrajectoryLibrary::setContinuousJoints(const string& group_name, const vector<bool>& continuous)
+{
+  GroupLibrary& group = groups_[group_name];
+  if (group.continuous == continuous)
+    return;
+
+  group.continuous = continuous;
+  if (!group.keys.empty() && group.keys[0].size() != 2*int(continuous.size()))
+  {
+    ROS_WARN("Group %s changed size, clearing its library", group_name.c_str());
+    group.keys.clear();
+    group.trajectories.clear();
+  }
+  for (unsigned int i=0; i<group.trajectories.size(); i++)
+  {
+    const MatrixXd& trajectory = group.trajectories[i];
+    group.keys[i] = makeKey(group, trajectory.row(0).transpose(), trajectory.row(trajectory.rows()-1).transpose());
+  }
+  group.tree_valid = false;
+}
+
+VectorXd TrajectoryLibrary::makeKey(const GroupLibrary& group, const VectorXd& start, const VectorXd& goal)
+{
+  int num_joints = start.size();
+  VectorXd key(2*num_joints);
+  key.head(num_joints) = start;
+  key.tail(num_joints) = goal;
+  for (int d=0; d<key.size(); d++)
+  {
+    if (isContinuousDimension(group, d))
+      key(d) = angles::normalize_angle(key(d));
+  }
+  return key;
+}
+
+bool TrajectoryLibrary::isContinuousDimension(const GroupLibrary& group, int dimension)
+{
+  int num_joints = group.continuous.size();
+  return num_joints > 0 && group.continuous[dimension % num_joints];
+}
+
+double TrajectoryLibrary::getKeyDifference(const GroupLibrary& group, const VectorXd& a, const VectorXd& b, int dimension)
+{
+  if (isContinuousDimension(group, dimension))
+    return angles::shortest_angular_distance(b(dimension), a(dimension));
+  return a(dimension) - b(dimension);
+}
+
+void TrajectoryLibrary::addTrajectory(const string& group_name, const MatrixXd& trajectory)
+{
+  if (max_size_ == 0 || trajectory.rows() < 2)
+    return;
+
+  GroupLibrary& group = groups_[group_name];
+
+  // the group's joints changed, so nothing stored for it is usable any more
+  if (!group.keys.empty() && group.keys[0].size() != 2*trajectory.cols())
+  {
+    ROS_WARN("Trajectories for group %s changed size, clearing its library", group_name.c_str());
+    group.keys.clear();
+    group.trajectories.clear();
+    group.tree_valid = false;
+  }
+  if (!group.continuous.empty() && int(group.continuous.size()) != trajectory.cols())
+    group.continuous.clear();
+  VectorXd key = makeKey(group, trajectory.row(0).transpose(), trajectory.row(trajectory.rows()-1).transpose());
+
+  double distance;
+  int nearest = findNearest(group, key, distance);
+  if (nearest >= 0 && distance < DUPLICATE_DISTANCE)
+  {
+    group.trajectories[nearest] = trajectory;
+    return;
+  }
+
+  if (group.keys.size() >= max_size_)
+  {
+    group.keys.erase(group.keys.begin());
+    group.trajectories.erase(group.trajectories.begin());
+  }
+  group.keys.push_back(key);
+  group.trajectories.push_back(trajectory);
+  group.tree_valid = false;
+}
+
+bool TrajectoryLibrary::getInitialTrajectory(const string& group_name, const VectorXd& start, const VectorXd& goal,
+                                             int num_points, MatrixXd& trajectory)
+{
+  map<string, GroupLibrary>::iterator it = groups_.find(group_name);
+  if (it == groups_.end() || num_points < 2)
+    return false;
+
+  GroupLibrary& group = it->second;
+  int num_joints = start.size();
+  if (group.keys.empty() || group.keys[0].size() != 2*num_joints)
+    return false;
+  VectorXd key = makeKey(group, start, goal);
+
+  double distance;
+  int nearest = findNearest(group, key, distance);
+  if (nearest < 0 || distance > max_distance_)
+    return false;
+  ROS_DEBUG("Nearest library trajectory for %s is %f away", group_name.c_str(), distance);
+
+  // resample the stored trajectory uniformly in time to the requested number of points
+  const MatrixXd& stored = group.trajectories[nearest];
+  int last_stored = stored.rows()-1;
+  trajectory.resize(num_points, num_joints);
+  for (int i=0; i<num_points; i++)
+  {
+    double t = double(i * last_stored) / double(num_points-1);
+    int index = std::min(int(floor(t)), last_stored-1);
+    double fraction = t - index;
+    trajectory.row(i) = (1.0-fraction)*stored.row(index) + fraction*stored.row(index+1);
+  }
+
+  // continuous joints were matched the short way round, so they're moved by whole turns to start
+  // next to the requested point before the offsets are taken
+  for (int j=0; j<num_joints && j<int(group.continuous.size()); j++)
+  {
+    if (!group.continuous[j])
+      continue;
+    double turns = start(j) - trajectory(0,j) - angles::shortest_angular_distance(trajectory(0,j), start(j));
+    trajectory.col(j).array() += turns;
+  }
+
+  // and shift it linearly in time so it starts and ends at the requested points
+  RowVectorXd start_offset = start.transpose() - trajectory.row(0);
+  RowVectorXd goal_offset = goal.transpose() - trajectory.row(num_points-1);
+  for (int i=0; i<num_points; i++)
+  {
+    double s = double(i) / double(num_points-1);
+    trajectory.row(i) += (1.0-s)*start_offset + s*goal_offset;
+  }
+  return true;
+}
+
+int TrajectoryLibrary::findNearest(GroupLibrary& group, const VectorXd& key, double& distance)
+{
+  if (group.keys.empty())
+    return -1;
+
+  if (!group.tree_valid)
+  {
+    int size = group.keys.size();
+    group.tree.resize(size);
+    group.split_dimensions.resize(size);
+    for (int i=0; i<size; i++)
+      group.tree[i] = i;
+    buildTree(group, 0, size);
+    group.tree_valid = true;
+  }
+
+  int nearest = -1;
+  double nearest_distance_sq = numeric_limits<double>::max();
+  searchTree(group, key, 0, group.tree.size(), nearest, nearest_distance_sq);
+  distance = sqrt(nearest_distance_sq);
+  return nearest;
+}
+
+void TrajectoryLibrary::buildTree(GroupLibrary& group, int begin, int end)
+{
+  if (begin >= end)
+    return;
+
+  // split on the dimension with the largest spread.  Continuous joints wrap, so the far side of a
+  // split in one of them can still be close, and they're never split on
+  int num_dimensions = group.keys[group.tree[begin]].size();
+  VectorXd min_key = group.keys[group.tree[begin]];
+  VectorXd max_key = min_key;
+  for (int i=begin+1; i<end; i++)
+  {
+    min_key = min_key.cwiseMin(group.keys[group.tree[i]]);
+    max_key = max_key.cwiseMax(group.keys[group.tree[i]]);
+  }
+  int dimension = -1;
+  for (int d=0; d<num_dimensions; d++)
+  {
+    if (isContinuousDimension(group, d))
+      continue;
+    if (dimension < 0 || max_key(d) - min_key(d) > max_key(dimension) - min_key(dimension))
+      dimension = d;
+  }
+
+  int middle = (begin + end) / 2;
+  if (dimension >= 0)
+    nth_element(group.tree.begin()+begin, group.tree.begin()+middle, group.tree.begin()+end,
+                CompareKeys(group.keys, dimension));
+  group.split_dimensions[middle] = dimension;
+
+  buildTree(group, begin, middle);
+  buildTree(group, middle+1, end);
+}
+
+void TrajectoryLibrary::searchTree(const GroupLibrary& group, const VectorXd& key, int begin, int end,
+                                   int& nearest, double& nearest_distance_sq) const
+{
+  if (begin >= end)
+    return;
+
+  int middle = (begin + end) / 2;
+  int index = group.tree[middle];
+  double distance_sq = 0.0;
+  for (int d=0; d<key.size(); d++)
+  {
+    double difference = getKeyDifference(group, key, group.keys[index], d);
+    distance_sq += difference*difference;
+  }
+  if (distance_sq < nearest_distance_sq)
+  {
+    nearest_distance_sq = distance_sq;
+    nearest = index;
+  }
+
+  int dimension = group.split_dimensions[middle];
+  if (dimension < 0)
+  {
+    searchTree(group, key, begin, middle, nearest, nearest_distance_sq);
+    searchTree(group, key, middle+1, end, nearest, nearest_distance_sq);
+    return;
+  }
+  double difference = key(dimension) - group.keys[index](dimension);
+  if (difference < 0.0)
+  {
+    searchTree(group, key, begin, middle, nearest, nearest_distance_sq);
+    if (difference*difference < nearest_distance_sq)
+      searchTree(group, key, middle+1, end, nearest, nearest_distance_sq);
+  }
+  else
+  {
+    searchTree(group, key, middle+1, end, nearest, nearest_distance_sq);
+    if (difference*difference < nearest_distance_sq)
+      searchTree(group, key, begin, middle, nearest, nearest_distance_sq);
+  }
+}
+
+bool TrajectoryLibrary::load(const string& filename)
+{
+  ifstream file(filename.c_str());
+  if (!file.is_open())
+  {
+    ROS_WARN("Couldn't open trajectory library %s", filename.c_str());
+    return false;
+  }
+
+  string header;
+  int version;
+  if (!(file >> header >> version) || header != LIBRARY_FILE_HEADER || version != LIBRARY_FILE_VERSION)
+  {
+    ROS_WARN("%s is not a trajectory library this version can read", filename.c_str());
+    return false;
+  }
+
+  string group_name;
+  int num_points, num_joints;
+  unsigned int count = 0;
+  while (file >> group_name >> num_points >> num_joints)
+  {
+    if (num_points < 2 || num_joints < 1)
+    {
+      ROS_WARN("Bad trajectory in library %s, ignoring the rest of it", filename.c_str());
+      return false;
+    }
+    MatrixXd trajectory(num_points, num_joints);
+    for (int i=0; i<num_points; i++)
+      for (int j=0; j<num_joints; j++)
+        file >> trajectory(i,j);
+    if (!file)
+    {
+      ROS_WARN("Trajectory library %s is truncated", filename.c_str());
+      return false;
+    }
+    addTrajectory(group_name, trajectory);
+    count++;
+  }
+  ROS_INFO("Loaded %u trajectories from library %s", count, filename.c_str());
+  return true;
+}
+
+bool TrajectoryLibrary::save(const string& filename) const
+{
+  ofstream file(filename.c_str());
+  if (!file.is_open())
+  {
+    ROS_WARN("Couldn't write trajectory library %s", filename.c_str());
+    return false;
+  }
+
+  file << LIBRARY_FILE_HEADER << " " << LIBRARY_FILE_VERSION << endl;
+  file << setprecision(numeric_limits<double>::digits10 + 2);
+  for (map<string, GroupLibrary>::const_iterator it = groups_.begin(); it != groups_.end(); it++)
+  {
+    const vector<MatrixXd>& trajectories = it->second.trajectories;
+    for (unsigned int k=0; k<trajectories.size(); k++)
+    {
+      const MatrixXd& trajectory = trajectories[k];
+      file << it->first << " " << trajectory.rows() << " " << trajectory.cols() << endl;
+      for (int i=0; i<trajectory.rows(); i++)
+      {
+        for (int j=0; j<trajectory.cols(); j++)
+          file << trajectory(i,j) << " ";
+        file << endl;
+      }
+    }
+  }
+  return file.good();
+}
+
+unsigned int TrajectoryLibrary::size() const
+{
+  unsigned int size = 0;
+  for (map<string, GroupLibrary>::const_iterator it = groups_.begin(); it != groups_.end(); it++)
+    size += it->second.keys.size();
+  return size;
+}
+
+void TrajectoryLibrary::clear()
+{
+  groups_.clear();
+}
+
+}
@@ -0,0 +1,186 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/** \author Mrinal Kalakrishnan */
+
+#include <gtest/gtest.h>
+
+#include <chomp_motion_planner/chomp_cost.h>
+#include <chomp_motion_planner/chomp_trajectory.h>
+#include <planning_models/kinematic_model.h>
+#include <urdf/model.h>
+#include <eigen3/Eigen/LU>
+
+using namespace chomp;
+using namespace Eigen;
+
+static const char* ONE_JOINT_URDF =
+  "<robot name=\"one_joint\">"
+  "  <link name=\"base_link\"/>"
+  "  <link name=\"link_1\"/>"
+  "  <joint name=\"joint_1\" type=\"revolute\">"
+  "    <parent link=\"base_link\"/>"
+  "    <child link=\"link_1\"/>"
+  "    <axis xyz=\"0 0 1\"/>"
+  "    <limit lower=\"-1.0\" upper=\"1.0\" effort=\"1.0\" velocity=\"1.0\"/>"
+  "  </joint>"
+  "</robot>";
+
+static const int NUM_DIFF_RULES = 3;
+static const int NUM_POINTS = 50;
+static const double DISCRETIZATION = 0.05;
+static const double TOLERANCE = 1e-8;
+
+class TestChompCost : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    urdf::Model urdf_model;
+    ASSERT_TRUE(urdf_model.initString(ONE_JOINT_URDF));
+    std::map<std::string, planning_models::KinematicModel::GroupConfig> group_configs;
+    group_configs["arm"] = planning_models::KinematicModel::GroupConfig("arm", "base_link", "link_1");
+    std::vector<planning_models::KinematicModel::MultiDofConfig> multi_dof_configs;
+    planning_models::KinematicModel::MultiDofConfig config("world_joint");
+    config.type = "Floating";
+    config.parent_frame_id = "world";
+    config.child_frame_id = "base_link";
+    multi_dof_configs.push_back(config);
+    robot_model_ = new planning_models::KinematicModel(urdf_model, group_configs, multi_dof_configs);
+    trajectory_ = new ChompTrajectory(robot_model_, NUM_POINTS, DISCRETIZATION, "arm");
+    ASSERT_EQ(1, trajectory_->getNumJoints());
+    srand(0);
+    for (int i=0; i<NUM_POINTS; i++)
+      (*trajectory_)(i, 0) = rand()/(RAND_MAX+1.0)-0.5;
+  }
+
+  virtual void TearDown()
+  {
+    delete trajectory_;
+    delete robot_model_;
+  }
+
+  // the quad cost over all points, built densely from the differentiation matrices
+  MatrixXd getDenseQuadCost(const std::vector<double>& derivative_costs, double ridge_factor) const
+  {
+    MatrixXd quad_cost = MatrixXd::Identity(NUM_POINTS, NUM_POINTS) * ridge_factor;
+    double multiplier = 1.0;
+    for (unsigned int i=0; i<derivative_costs.size(); i++)
+    {
+      multiplier *= DISCRETIZATION;
+      MatrixXd diff_matrix = MatrixXd::Zero(NUM_POINTS, NUM_POINTS);
+      for (int r=0; r<NUM_POINTS; r++)
+      {
+        for (int p=-DIFF_RULE_LENGTH/2; p<=DIFF_RULE_LENGTH/2; p++)
+        {
+          if (r+p >= 0 && r+p < NUM_POINTS)
+            diff_matrix(r, r+p) = DIFF_RULES[i][p+DIFF_RULE_LENGTH/2];
+        }
+      }
+      quad_cost += (derivative_costs[i] * multiplier) * diff_matrix.transpose() * diff_matrix;
+    }
+    return quad_cost;
+  }
+
+  void checkCost(const std::vector<double>& derivative_costs, double ridge_factor)
+  {
+    ChompCost cost(*trajectory_, 0, derivative_costs, ridge_factor);
+    MatrixXd full_quad_cost = getDenseQuadCost(derivative_costs, ridge_factor);
+    int free_start = DIFF_RULE_LENGTH-1;
+    int num_free = NUM_POINTS - 2*free_start;
+    MatrixXd quad_cost = full_quad_cost.block(free_start, free_start, num_free, num_free);
+    EXPECT_LT((cost.getQuadraticCost() - quad_cost).norm(), TOLERANCE * quad_cost.norm());
+
+    MatrixXd quad_cost_inv = cost.getQuadraticCost().inverse();
+    double scale = quad_cost_inv.norm();
+    EXPECT_LT((cost.getQuadraticCostInverse() - quad_cost_inv).norm(), TOLERANCE * scale);
+
+    VectorXd vector = VectorXd::Zero(num_free);
+    for (int i=0; i<num_free; i++)
+      vector(i) = (*trajectory_)(free_start+i, 0);
+    VectorXd expected = quad_cost_inv * vector;
+    cost.applyQuadraticCostInverse(vector);
+    EXPECT_LT((vector - expected).norm(), TOLERANCE * expected.norm());
+
+    for (int i=0; i<num_free; i++)
+      EXPECT_NEAR(quad_cost_inv(i, i), cost.getQuadraticCostInverseDiagonal(i), TOLERANCE * scale);
+    EXPECT_NEAR(quad_cost_inv.diagonal().maxCoeff(), cost.getMaxQuadCostInvValue(), TOLERANCE * scale);
+
+    Eigen::MatrixXd::ColXpr joint_trajectory = trajectory_->getJointTrajectory(0);
+    VectorXd positions = joint_trajectory;
+    double expected_cost = positions.dot(full_quad_cost * positions);
+    EXPECT_NEAR(expected_cost, cost.getCost(joint_trajectory), TOLERANCE * fabs(expected_cost));
+
+    VectorXd derivative(NUM_POINTS);
+    cost.getDerivative(joint_trajectory, derivative);
+    VectorXd expected_derivative = 2.0 * full_quad_cost * positions;
+    EXPECT_LT((derivative - expected_derivative).norm(), TOLERANCE * expected_derivative.norm());
+
+    // the factor maps independent samples to ones with the inverse as their covariance
+    MatrixXd factor(num_free, num_free);
+    for (int i=0; i<num_free; i++)
+    {
+      VectorXd column = VectorXd::Zero(num_free);
+      column(i) = 1.0;
+      cost.applyQuadraticCostInverseFactor(column);
+      factor.col(i) = column;
+    }
+    EXPECT_LT((factor * factor.transpose() - quad_cost_inv).norm(), TOLERANCE * scale);
+  }
+
+  planning_models::KinematicModel* robot_model_;
+  ChompTrajectory* trajectory_;
+};
+
+TEST_F(TestChompCost, TestEachDerivative)
+{
+  for (int i=0; i<NUM_DIFF_RULES; i++)
+  {
+    std::vector<double> derivative_costs(i+1, 0.0);
+    derivative_costs[i] = 1.0;
+    checkCost(derivative_costs, 0.0);
+  }
+}
+
+TEST_F(TestChompCost, TestRidgeFactor)
+{
+  std::vector<double> derivative_costs(NUM_DIFF_RULES, 1.0);
+  checkCost(derivative_costs, 1e-4);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
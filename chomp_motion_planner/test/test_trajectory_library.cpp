@@ -0,0 +1,265 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/** \author Mrinal Kalakrishnan */
+
+#include <gtest/gtest.h>
+
+#include <chomp_motion_planner/trajectory_library.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+using namespace chomp;
+using namespace Eigen;
+
+static const int NUM_JOINTS = 3;
+static const int NUM_POINTS = 11;
+
+static double gen_rand(double min, double max)
+{
+  return min+(max-min)*(rand()/(RAND_MAX+1.0));
+}
+
+// a straight line between the two points
+static MatrixXd makeTrajectory(const VectorXd& start, const VectorXd& goal)
+{
+  MatrixXd trajectory(NUM_POINTS, start.size());
+  for (int i=0; i<NUM_POINTS; i++)
+  {
+    double s = double(i) / double(NUM_POINTS-1);
+    trajectory.row(i) = ((1.0-s)*start + s*goal).transpose();
+  }
+  return trajectory;
+}
+
+static VectorXd makeRandomPoint()
+{
+  VectorXd point(NUM_JOINTS);
+  for (int j=0; j<NUM_JOINTS; j++)
+    point(j) = gen_rand(-M_PI, M_PI);
+  return point;
+}
+
+static double getKeyDistance(const VectorXd& a, const VectorXd& b, const std::vector<bool>& continuous)
+{
+  double distance_sq = 0.0;
+  for (int j=0; j<a.size(); j++)
+  {
+    double difference = a(j)-b(j);
+    if (continuous[j])
+      difference = fabs(difference) > M_PI ? 2.0*M_PI-fabs(difference) : difference;
+    distance_sq += difference*difference;
+  }
+  return distance_sq;
+}
+
+// checks the k-d tree lookups against a brute force search
+static void checkNearest(const std::vector<bool>& continuous)
+{
+  srand(0);
+  TrajectoryLibrary library;
+  library.setParameters(200, 100.0);
+  library.setContinuousJoints("arm", continuous);
+  std::vector<VectorXd> starts, goals, bumps;
+  for (int i=0; i<200; i++)
+  {
+    starts.push_back(makeRandomPoint());
+    goals.push_back(makeRandomPoint());
+    bumps.push_back(makeRandomPoint());
+    MatrixXd trajectory = makeTrajectory(starts.back(), goals.back());
+    trajectory.row(NUM_POINTS/2) += bumps.back().transpose();
+    library.addTrajectory("arm", trajectory);
+  }
+  ASSERT_EQ(200u, library.size());
+
+  for (int q=0; q<100; q++)
+  {
+    VectorXd start = makeRandomPoint();
+    VectorXd goal = makeRandomPoint();
+    int nearest = -1;
+    double nearest_distance = std::numeric_limits<double>::max();
+    for (unsigned int i=0; i<starts.size(); i++)
+    {
+      double distance = getKeyDistance(starts[i], start, continuous) + getKeyDistance(goals[i], goal, continuous);
+      if (distance < nearest_distance)
+      {
+        nearest_distance = distance;
+        nearest = i;
+      }
+    }
+
+    // warping a stored trajectory gives the line between the requested points,
+    // plus the bump that tells which one it was
+    MatrixXd trajectory;
+    ASSERT_TRUE(library.getInitialTrajectory("arm", start, goal, NUM_POINTS, trajectory));
+    EXPECT_LT((trajectory.row(0).transpose()-start).norm(), 1e-9);
+    EXPECT_LT((trajectory.row(NUM_POINTS-1).transpose()-goal).norm(), 1e-9);
+    VectorXd bump = trajectory.row(NUM_POINTS/2).transpose() - 0.5*(start+goal);
+    EXPECT_LT((bump-bumps[nearest]).norm(), 1e-9);
+  }
+}
+
+TEST(TestTrajectoryLibrary, TestNearestMatchesBruteForce)
+{
+  checkNearest(std::vector<bool>(NUM_JOINTS, false));
+}
+
+TEST(TestTrajectoryLibrary, TestNearestMatchesBruteForceWithContinuousJoints)
+{
+  std::vector<bool> continuous(NUM_JOINTS, false);
+  continuous[0] = true;
+  checkNearest(continuous);
+}
+
+TEST(TestTrajectoryLibrary, TestMaxDistance)
+{
+  TrajectoryLibrary library;
+  library.setParameters(10, 0.1);
+  VectorXd start = VectorXd::Zero(NUM_JOINTS);
+  VectorXd goal = VectorXd::Ones(NUM_JOINTS);
+  library.addTrajectory("arm", makeTrajectory(start, goal));
+
+  MatrixXd trajectory;
+  EXPECT_TRUE(library.getInitialTrajectory("arm", start, goal, NUM_POINTS, trajectory));
+  EXPECT_FALSE(library.getInitialTrajectory("arm", start, goal*2.0, NUM_POINTS, trajectory));
+  EXPECT_FALSE(library.getInitialTrajectory("other_arm", start, goal, NUM_POINTS, trajectory));
+}
+
+TEST(TestTrajectoryLibrary, TestDuplicateReplaced)
+{
+  TrajectoryLibrary library;
+  library.setParameters(10, 1.0);
+  VectorXd start = VectorXd::Zero(NUM_JOINTS);
+  VectorXd goal = VectorXd::Ones(NUM_JOINTS);
+  MatrixXd first = makeTrajectory(start, goal);
+  library.addTrajectory("arm", first);
+
+  // same endpoints, but a detour in the middle
+  MatrixXd second = first;
+  second.row(NUM_POINTS/2).array() += 0.5;
+  library.addTrajectory("arm", second);
+  EXPECT_EQ(1u, library.size());
+
+  MatrixXd trajectory;
+  ASSERT_TRUE(library.getInitialTrajectory("arm", start, goal, NUM_POINTS, trajectory));
+  EXPECT_LT((trajectory-second).norm(), 1e-9);
+}
+
+TEST(TestTrajectoryLibrary, TestOldestEvicted)
+{
+  TrajectoryLibrary library;
+  library.setParameters(3, 0.01);
+  VectorXd goal = VectorXd::Ones(NUM_JOINTS);
+  for (int i=0; i<4; i++)
+    library.addTrajectory("arm", makeTrajectory(VectorXd::Constant(NUM_JOINTS, i), goal));
+  EXPECT_EQ(3u, library.size());
+
+  MatrixXd trajectory;
+  EXPECT_FALSE(library.getInitialTrajectory("arm", VectorXd::Constant(NUM_JOINTS, 0), goal, NUM_POINTS, trajectory));
+  for (int i=1; i<4; i++)
+    EXPECT_TRUE(library.getInitialTrajectory("arm", VectorXd::Constant(NUM_JOINTS, i), goal, NUM_POINTS, trajectory));
+
+  // shrinking the library drops the oldest too
+  library.setParameters(1, 0.01);
+  EXPECT_EQ(1u, library.size());
+  EXPECT_TRUE(library.getInitialTrajectory("arm", VectorXd::Constant(NUM_JOINTS, 3), goal, NUM_POINTS, trajectory));
+}
+
+TEST(TestTrajectoryLibrary, TestSaveLoad)
+{
+  srand(1);
+  TrajectoryLibrary library;
+  library.setParameters(20, 0.01);
+  std::vector<MatrixXd> trajectories;
+  for (int i=0; i<5; i++)
+  {
+    trajectories.push_back(makeTrajectory(makeRandomPoint(), makeRandomPoint()));
+    trajectories.back().row(NUM_POINTS/2).array() += gen_rand(-1.0, 1.0);
+    library.addTrajectory(i%2 ? "left_arm" : "right_arm", trajectories.back());
+  }
+  std::string filename = "/tmp/test_trajectory_library.txt";
+  ASSERT_TRUE(library.save(filename));
+
+  TrajectoryLibrary loaded;
+  loaded.setParameters(20, 0.01);
+  ASSERT_TRUE(loaded.load(filename));
+  remove(filename.c_str());
+  EXPECT_EQ(library.size(), loaded.size());
+  for (int i=0; i<5; i++)
+  {
+    const MatrixXd& stored = trajectories[i];
+    MatrixXd trajectory;
+    ASSERT_TRUE(loaded.getInitialTrajectory(i%2 ? "left_arm" : "right_arm", stored.row(0).transpose(),
+                                            stored.row(NUM_POINTS-1).transpose(), NUM_POINTS, trajectory));
+    EXPECT_LT((trajectory-stored).norm(), 1e-12);
+  }
+
+  EXPECT_FALSE(loaded.load("/tmp/test_trajectory_library_missing.txt"));
+}
+
+TEST(TestTrajectoryLibrary, TestContinuousJointsWrap)
+{
+  TrajectoryLibrary library;
+  library.setParameters(10, 0.1);
+  std::vector<bool> continuous(NUM_JOINTS, false);
+  continuous[0] = true;
+  library.setContinuousJoints("arm", continuous);
+
+  VectorXd start = VectorXd::Zero(NUM_JOINTS);
+  VectorXd goal = VectorXd::Zero(NUM_JOINTS);
+  start(0) = M_PI - 0.01;
+  goal(0) = M_PI + 0.2;
+  library.addTrajectory("arm", makeTrajectory(start, goal));
+
+  // the same request, but with the continuous joint a turn around
+  VectorXd wrapped_start = start;
+  VectorXd wrapped_goal = goal;
+  wrapped_start(0) -= 2.0*M_PI;
+  wrapped_goal(0) -= 2.0*M_PI;
+  MatrixXd trajectory;
+  ASSERT_TRUE(library.getInitialTrajectory("arm", wrapped_start, wrapped_goal, NUM_POINTS, trajectory));
+  EXPECT_LT((trajectory-makeTrajectory(wrapped_start, wrapped_goal)).norm(), 1e-9);
+
+  // without the wrap the endpoints are two turns apart
+  library.setContinuousJoints("arm", std::vector<bool>(NUM_JOINTS, false));
+  EXPECT_FALSE(library.getInitialTrajectory("arm", wrapped_start, wrapped_goal, NUM_POINTS, trajectory));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/** \author E. Gil Jones */
+
+#ifndef BODY_DECOMPOSITION_CACHE_
+#define BODY_DECOMPOSITION_CACHE_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <collision_proximity/collision_proximity_types.h>
+
+namespace collision_proximity
+{
+
+//keeps the spheres and relative points of previously computed body
+//decompositions so they can be reused, optionally across restarts
+class BodyDecompositionCache
+{
+public:
+
+  BodyDecompositionCache() :
+    modified_(false)
+  {}
+
+  //returns a new decomposition built from the cache, or NULL if the key isn't present
+  BodyDecomposition* createBodyDecomposition(const std::string& key,
+                                             const std::string& object_name,
+                                             const shapes::Shape* shape,
+                                             double padding) const;
+
+  //stores the relative spheres and points of the decomposition under the key
+  void addBodyDecomposition(const std::string& key, const BodyDecomposition* bd);
+
+  bool hasKey(const std::string& key) const {
+    return entries_.find(key) != entries_.end();
+  }
+
+  unsigned int getSize() const {
+    return entries_.size();
+  }
+
+  //true if entries were added since the last load or save
+  bool isModified() const {
+    return modified_;
+  }
+
+  void clear() {
+    entries_.clear();
+    modified_ = false;
+  }
+
+  //replaces the contents with those stored in the file
+  bool load(const std::string& filename);
+
+  bool save(const std::string& filename);
+
+private:
+
+  struct Entry {
+    tf::Transform relative_cylinder_pose;
+    std::vector<CollisionSphere> collision_spheres;
+    std::vector<tf::Vector3> relative_collision_points;
+  };
+
+  std::map<std::string, Entry> entries_;
+  bool modified_;
+};
+
+}
+
+#endif
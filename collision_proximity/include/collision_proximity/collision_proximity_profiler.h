@@ -0,0 +1,180 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+#ifndef COLLISION_PROXIMITY_PROFILER_
+#define COLLISION_PROXIMITY_PROFILER_
+
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+#include <boost/thread/mutex.hpp>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+namespace collision_proximity
+{
+
+//call counts and latency histograms for the collision proximity queries.
+//Everything is a no-op while disabled, and recording is thread safe
+class CollisionProximityProfiler
+{
+public:
+
+  enum Timer {
+    SETUP_GROUP_QUERIES,
+    ENVIRONMENT_FIELD,
+    SELF_FIELD,
+    SET_GROUP_STATE,
+    STATE_GRADIENTS,
+    STATE_COLLISION,
+    TRAJECTORY_SAFETY,
+    NUM_TIMERS
+  };
+
+  enum Counter {
+    SPHERES_EVALUATED,
+    SPHERE_PAIRS_EVALUATED,
+    FIELD_LOOKUPS,
+    GRADIENT_CACHE_HITS,
+    GRADIENT_CACHE_MISSES,
+    NUM_COUNTERS
+  };
+
+  //bucket i holds calls taking under 2^i microseconds, the last one everything longer
+  static const unsigned int NUM_BUCKETS = 24;
+
+  CollisionProximityProfiler();
+
+  void setEnabled(bool enabled) {
+    enabled_ = enabled;
+  }
+
+  bool isEnabled() const {
+    return enabled_;
+  }
+
+  void addTime(Timer timer, double seconds);
+
+  void addCount(Counter counter, unsigned long count);
+
+  void reset();
+
+  //one status per timer with the call statistics and histogram, and one with the counters
+  void getDiagnostics(std::vector<diagnostic_msgs::DiagnosticStatus>& statuses) const;
+
+  static std::string getTimerName(Timer timer);
+
+  static std::string getCounterName(Counter counter);
+
+private:
+
+  struct Histogram {
+    Histogram() :
+      calls(0), total(0.0), min(0.0), max(0.0), buckets(NUM_BUCKETS, 0)
+    {}
+
+    unsigned long calls;
+    double total, min, max;
+    std::vector<unsigned long> buckets;
+  };
+
+  bool enabled_;
+  mutable boost::mutex mutex_;
+  std::vector<Histogram> histograms_;
+  std::vector<unsigned long> counters_;
+};
+
+//adds the time between construction and destruction to a timer if the profiler is enabled
+class ScopedProfileTimer
+{
+public:
+
+  ScopedProfileTimer(CollisionProximityProfiler& profiler, CollisionProximityProfiler::Timer timer) :
+    profiler_(profiler),
+    timer_(timer),
+    enabled_(profiler.isEnabled())
+  {
+    if(enabled_) {
+      start_ = ros::WallTime::now();
+    }
+  }
+
+  ~ScopedProfileTimer()
+  {
+    if(enabled_) {
+      profiler_.addTime(timer_, (ros::WallTime::now()-start_).toSec());
+    }
+  }
+
+private:
+
+  CollisionProximityProfiler& profiler_;
+  CollisionProximityProfiler::Timer timer_;
+  bool enabled_;
+  ros::WallTime start_;
+};
+
+//adds up a count locally, recording it once on destruction
+class ScopedProfileCount
+{
+public:
+
+  ScopedProfileCount(CollisionProximityProfiler& profiler, CollisionProximityProfiler::Counter counter) :
+    count(0),
+    profiler_(profiler),
+    counter_(counter)
+  {
+  }
+
+  ~ScopedProfileCount()
+  {
+    if(count != 0) {
+      profiler_.addCount(counter_, count);
+    }
+  }
+
+  unsigned long count;
+
+private:
+
+  CollisionProximityProfiler& profiler_;
+  CollisionProximityProfiler::Counter counter_;
+};
+
+}
+
+#endif
@@ -49,6 +49,10 @@
 #include <planning_environment/models/collision_models_interface.h>
 
 #include <collision_proximity/collision_proximity_types.h>
+#include <collision_proximity/body_decomposition_cache.h>
+#include <collision_proximity/collision_proximity_profiler.h>
+#include <collision_proximity/sphere_distance_kernel.h>
+#include <collision_proximity/gradient_cache.h>
 
 namespace collision_proximity
 {
@@ -74,6 +78,22 @@ public:
     InCollisionSafe
   };
 
+  //posed collision spheres of the current group in one state, so that
+  //several states can be queried at once from different threads
+  struct GroupStateContext
+  {
+    //link spheres followed by attached body spheres, in current group order
+    std::vector<std::vector<CollisionSphere> > body_spheres;
+    std::vector<tf::Vector3> link_bounding_sphere_centers;
+    //gradient structures holding the sphere locations
+    std::vector<GradientInfo> gradients;
+    //body_spheres laid out for the intra group distance kernel
+    std::vector<SphereBlock> body_sphere_blocks;
+    //values of every joint in the state the spheres were posed at, as links
+    //outside the group move the group too.  Only filled in when caching gradients
+    std::vector<double> joint_values;
+  };
+
   CollisionProximitySpace(const std::string& robot_description_name, bool register_with_environment_server = true, bool use_signed_environment_field = false, bool use_signed_self_field = false);
   ~CollisionProximitySpace();
 
@@ -90,10 +110,19 @@ public:
   // sets the current group given the kinematic state
   void setCurrentGroupState(const planning_models::KinematicState& state);
 
+  // poses the spheres of the current group given the kinematic state without 
+  // changing the space, so it is safe to call from several threads between
+  // setupForGroupQueries and revertAfterGroupQueries
+  void setGroupStateContext(const planning_models::KinematicState& state,
+                            GroupStateContext& context) const;
+
   // returns true if the current group is in collision in the indicated state.
   // This doesn't affect the distance field or other robot links not in the group
   bool isStateInCollision() const;
 
+  // same as above for a state set with setGroupStateContext
+  bool isStateInCollision(const GroupStateContext& context) const;
+
   // returns the full set of collision information for each group link
   bool getStateCollisions(bool& in_collision, 
                           std::vector<CollisionType>& collisions) const;
@@ -102,6 +131,11 @@ public:
   bool getStateGradients(std::vector<GradientInfo>& gradients, 
                          bool subtract_radii = false) const;
 
+  // same as above for a state set with setGroupStateContext
+  bool getStateGradients(const GroupStateContext& context,
+                         std::vector<GradientInfo>& gradients, 
+                         bool subtract_radii = false) const;
+
   bool getIntraGroupCollisions(std::vector<bool>& collisions,
                                bool stop_at_first = false) const;
   
@@ -136,9 +170,6 @@ public:
 
   // returns the single closest proximity for the group previously configured
   //bool getEnvironmentProximity(ProximityInfo& prox) const;
-  
-  // returns true or false for environment collisions for the group that's been configured
-  //bool getEnvironmentCollision() const;
 
   //
   //visualization functions
@@ -188,6 +219,16 @@ public:
 
   void setCollisionTolerance(double tol) {
     tolerance_ = tol;
+    //cached collision flags were found against the old tolerance
+    gradient_cache_.invalidate();
+  }
+
+  const CollisionProximityProfiler& getProfiler() const {
+    return profiler_;
+  }
+
+  const GradientCache& getGradientCache() const {
+    return gradient_cache_;
   }
 
   // Set to public to allow user to manually call these if callback overriden
@@ -196,16 +237,112 @@ public:
 
 private:
 
+  //results of the per-point evaluation in isTrajectorySafe, defined in the source
+  struct TrajectoryEvaluation;
+
   // updates the current state of the spheres in the gradient
   bool updateSphereLocations(const std::vector<std::string>& link_names,
                              const std::vector<std::string>& attached_body_names, 
                              std::vector<GradientInfo>& gradients);
 
+  bool getIntraGroupCollisions(const GroupStateContext& context,
+                               std::vector<bool>& collisions,
+                               bool stop_at_first) const;
+  
+  bool getIntraGroupProximityGradients(const GroupStateContext& context,
+                                       std::vector<GradientInfo>& gradients,
+                                       bool subtract_radii) const;
+
+  bool getSelfCollisions(const GroupStateContext& context,
+                         std::vector<bool>& collisions,
+                         bool stop_at_first) const;
+  
+  bool getSelfProximityGradients(const GroupStateContext& context,
+                                 std::vector<GradientInfo>& gradients,
+                                 bool subtract_radii) const;
 
+  bool getEnvironmentCollisions(const GroupStateContext& context,
+                                std::vector<bool>& collisions,
+                                bool stop_at_first) const;
+  
+  bool getEnvironmentProximityGradients(const GroupStateContext& context,
+                                        std::vector<GradientInfo>& gradients,
+                                        bool subtract_radii) const;
+
+  // the uncached work behind getStateGradients
+  bool computeStateGradients(const GroupStateContext& context,
+                             std::vector<GradientInfo>& gradients,
+                             bool subtract_radii) const;
+
+  // sets the group to the positions and gets the gradients with radii subtracted, 
+  // returning true if any sphere is in collision
+  bool evaluateTrajectoryPoint(planning_models::KinematicState& state,
+                               planning_models::KinematicState::JointStateGroup* state_group,
+                               GroupStateContext& context,
+                               const std::vector<double>& positions,
+                               std::vector<GradientInfo>& gradients,
+                               std::vector<double>& distances) const;
+
+  // mesh checks only the trajectory points the distance fields don't show to be
+  // further than the safety margin from everything.  Fills in the evaluation for every point,
+  // and an error code for every point, with the ones cleared by the margin as successes
+  bool isTrajectoryValidOutsideMargin(const trajectory_msgs::JointTrajectory& trajectory,
+                                      const std::string& group_name,
+                                      TrajectoryEvaluation& evaluation,
+                                      arm_navigation_msgs::ArmNavigationErrorCodes& error_code,
+                                      std::vector<arm_navigation_msgs::ArmNavigationErrorCodes>& error_codes);
+
+  // runs evaluateTrajectoryPoints in trajectory_safety_threads_ threads, if more than one
+  void evaluateTrajectoryInParallel(const trajectory_msgs::JointTrajectory& trajectory,
+                                    const std::string& group_name,
+                                    TrajectoryEvaluation& evaluation) const;
+
+  // evaluates every num_threads'th trajectory point starting at thread_index 
+  // in a copy of the start state, stopping once the trajectory is known to be unsafe
+  void evaluateTrajectoryPoints(const planning_models::KinematicState* start_state,
+                                const std::string& group_name,
+                                const trajectory_msgs::JointTrajectory* trajectory,
+                                unsigned int thread_index,
+                                unsigned int num_threads,
+                                TrajectoryEvaluation* evaluation) const;
+
+  // returns true if every joint in the group is a single revolute or prismatic
+  // joint, which is what the swept sphere travel bound handles
+  bool canBoundSweptSpheres(const planning_models::KinematicState::JointStateGroup* state_group) const;
+
+  // bounds how far each sphere can move while the group goes in a straight line in
+  // joint space between the two positions.  Each joint contributes its change times
+  // the sphere's largest possible distance from its axis, taken along the kinematic chain
+  void getSweptSphereTravelBounds(planning_models::KinematicState& state,
+                                  planning_models::KinematicState::JointStateGroup* state_group,
+                                  const std::vector<double>& positions_1,
+                                  const std::vector<GradientInfo>& gradients_1,
+                                  const std::vector<double>& positions_2,
+                                  const std::vector<GradientInfo>& gradients_2,
+                                  std::vector<std::vector<double> >& travel_bounds) const;
+
+  // checks that the spheres stay clear moving between two collision-free points.
+  // The segment is safe if the clear balls at each sphere's ends cover its bounded
+  // travel, and is bisected in joint space wherever they don't
+  bool isSweptSegmentSafe(planning_models::KinematicState& state,
+                          planning_models::KinematicState::JointStateGroup* state_group,
+                          GroupStateContext& context,
+                          const std::vector<double>& positions_1,
+                          const std::vector<GradientInfo>& gradients_1,
+                          const std::vector<double>& positions_2,
+                          const std::vector<GradientInfo>& gradients_2,
+                          unsigned int depth) const;
 
   void deleteAllStaticObjectDecompositions();
   void deleteAllAttachedObjectDecompositions();
 
+  void publishProfilingDiagnostics(const ros::WallTimerEvent& event);
+
+  // makes the decomposition of a static or attached object shape, reusing the
+  // spheres and points of earlier objects with the same shape
+  BodyDecomposition* createObjectBodyDecomposition(const std::string& name,
+                                                   const shapes::Shape* shape);
+
   // sets the poses of the body to those held in the kinematic state
   void setBodyPosesToCurrent();
 
@@ -231,6 +368,22 @@ private:
   void prepareSelfDistanceField(const std::vector<std::string>& link_names, 
                                 const planning_models::KinematicState& state);
 
+  // distance and gradient to everything in the self field, with the links
+  // looked up in their own link-local fields
+  double getSelfDistanceGradient(const tf::Vector3& point, tf::Vector3& gradient) const;
+
+  // same as getCollisionSphereGradients on the self field, but using link-local fields
+  bool getLocalSelfSphereGradients(const std::vector<CollisionSphere>& sphere_list,
+                                   GradientInfo& gradient,
+                                   bool subtract_radii,
+                                   bool stop_at_first_collision) const;
+
+  // makes the field hold exactly the given points, only propagating the
+  // changed voxels unless the field is signed
+  void updateDistanceFieldPoints(distance_field::DistanceField<distance_field::PropDistanceFieldVoxel>* distance_field,
+                                 bool is_signed,
+                                 const std::vector<tf::Vector3>& points);
+
 
   //double getCollisionSphereProximity(const std::vector<CollisionSphere>& sphere_list, 
   //                                  unsigned int& closest, tf::Vector3& grad) const;
@@ -245,6 +398,31 @@ private:
 
   distance_field::DistanceField<distance_field::PropDistanceFieldVoxel>* environment_distance_field_;
   distance_field::DistanceField<distance_field::PropDistanceFieldVoxel>* self_distance_field_;
+  bool use_signed_environment_field_;
+  bool use_signed_self_field_;
+
+  //points currently in the environment distance field, keyed by object namespace
+  std::map<std::string, std::vector<tf::Vector3> > environment_distance_field_points_;
+
+  //points currently in the self distance field, keyed by link name or attached object id
+  std::map<std::string, std::vector<tf::Vector3> > self_distance_field_points_;
+
+  //if set, links are left out of the self field and queried in their own frames
+  bool use_link_local_self_fields_;
+  std::map<std::string, LocalDistanceField*> local_distance_field_map_;
+  std::vector<const LocalDistanceField*> current_self_local_fields_;
+  std::vector<tf::Transform> current_self_local_field_poses_;
+  std::vector<tf::Transform> current_self_local_field_inverse_poses_;
+
+  //whether isTrajectorySafe checks the motion between points, and how many times it may bisect
+  bool use_swept_sphere_checking_;
+  unsigned int swept_sphere_max_depth_;
+
+  //number of threads isTrajectorySafe evaluates points with
+  unsigned int trajectory_safety_threads_;
+
+  //clearance above which isTrajectorySafe skips the mesh check for unconstrained trajectories, 0 to always check
+  double trajectory_safety_margin_;
 
   planning_environment::CollisionModelsInterface* collision_models_interface_;
 
@@ -254,10 +432,20 @@ private:
   ros::Publisher vis_marker_publisher_;
   ros::Publisher vis_marker_array_publisher_;
 
+  //timings and query counts, only recorded if profiling is enabled
+  mutable CollisionProximityProfiler profiler_;
+  ros::Publisher diagnostics_publisher_;
+  ros::WallTimer profiling_timer_;
+
+  //gradients of recently queried group states, emptied whenever the scene or group changes
+  mutable GradientCache gradient_cache_;
+
   mutable boost::recursive_mutex group_queries_lock_;
 
   std::map<std::string, BodyDecomposition*> body_decomposition_map_;
   std::map<std::string, BodyDecompositionVector*> static_object_map_;
+  //shapes and poses the static object decompositions were made for
+  std::map<std::string, std::string> static_object_signatures_;
   std::map<std::string, BodyDecompositionVector*> attached_object_map_;
 
   std::map<std::string, std::map<std::string, bool> > enabled_self_collision_links_;
@@ -278,6 +466,9 @@ private:
 
   //just for initializing input
   std::vector<GradientInfo> current_gradients_;
+
+  //spheres posed by the last setCurrentGroupState
+  GroupStateContext current_context_;
   
   //distance field configuration
   double size_x_, size_y_, size_z_;
@@ -288,6 +479,17 @@ private:
   double max_self_distance_;
   double undefined_distance_;
 
+  //how robot link collision spheres are generated
+  SphereDecompositionParameters sphere_decomposition_parameters_;
+
+  //robot link decompositions persisted across restarts if a file is given
+  BodyDecompositionCache body_decomposition_cache_;
+  std::string body_decomposition_cache_file_;
+
+  //decompositions of object shapes seen before, cleared when it reaches the size limit
+  BodyDecompositionCache object_decomposition_cache_;
+  unsigned int object_decomposition_cache_size_;
+
 };
 
 }
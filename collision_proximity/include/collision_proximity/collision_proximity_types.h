@@ -97,21 +97,74 @@ struct GradientInfo
   std::vector<double> sphere_radii;
   std::string joint_name;
 
+  //what the distance fields and the other spheres in the group prove about each
+  //sphere's surface clearance.  The merged distances can't tell a saturated field
+  //from a measured one, so these are kept apart.  Only filled in with radii subtracted
+  std::vector<double> field_clearances;
+  std::vector<double> intra_clearances;
+
   void clear() {
     closest_distance = DBL_MAX;
     collision = false;
     sphere_locations.clear();
     distances.clear();
     gradients.clear();
+    field_clearances.clear();
+    intra_clearances.clear();
   }
 };
 
+struct SphereDecompositionParameters
+{
+  enum Method {
+    BOUNDING_CYLINDER,
+    GREEDY_COVER
+  };
+
+  SphereDecompositionParameters() :
+    method(BOUNDING_CYLINDER),
+    max_error(0.01),
+    max_spheres(20)
+  {
+  }
+
+  Method method;
+  //how far a greedy cover sphere is allowed to extend past the body surface
+  double max_error;
+  //upper bound on the number of spheres a greedy cover may use
+  unsigned int max_spheres;
+};
+
 //determines set of collision spheres given a posed body
 std::vector<CollisionSphere> determineCollisionSpheres(const bodies::Body* body, tf::Transform& relativeTransform);
 
+//determines a set of spheres covering the supplied interior points of the body
+//by greedy set cover; each sphere extends at most max_error past the surface
+//unless the max_spheres budget runs out, in which case the chosen spheres are
+//grown until every point is covered.  Sphere positions are relative to the body pose
+std::vector<CollisionSphere> determineCollisionSpheresGreedy(const bodies::Body* body, 
+                                                             const std::vector<tf::Vector3>& interior_points,
+                                                             double resolution,
+                                                             double max_error,
+                                                             unsigned int max_spheres);
+
+//returns a hash of the shape type and its dimensions or mesh data
+unsigned long long computeShapeHash(const shapes::Shape* shape);
+
+//returns a key that identifies the decomposition of the shape with the given parameters
+std::string makeBodyDecompositionKey(const shapes::Shape* shape, 
+                                     double resolution, 
+                                     double padding, 
+                                     const SphereDecompositionParameters& sphere_parameters);
+
 //determines a set of points at the indicated resolution that are inside the supplied body 
 std::vector<tf::Vector3> determineCollisionPoints(const bodies::Body* body, double resolution);
 
+//same as above, but fills each lattice column at once: in closed form for spheres, 
+//boxes and cylinders if the shape the body was created from is supplied, and by ray
+//casting otherwise.  Relies on the body being convex, which holds for all body types
+std::vector<tf::Vector3> determineCollisionPoints(const bodies::Body* body, const shapes::Shape* shape, double resolution);
+
 //determines a set of gradients of the given collision spheres in the distance field
 bool getCollisionSphereGradients(const distance_field::DistanceField<distance_field::PropDistanceFieldVoxel>* distance_field,
                                  const std::vector<CollisionSphere>& sphere_list, 
@@ -121,10 +174,39 @@ bool getCollisionSphereGradients(const distance_field::DistanceField<distance_fi
                                  double maximum_value, 
                                  bool stop_at_first_collision);
 
+//returns true if any sphere is within tolerance of an obstacle, using plain distance lookups
 bool getCollisionSphereCollision(const distance_field::DistanceField<distance_field::PropDistanceFieldVoxel>* distance_field,
                                  const std::vector<CollisionSphere>& sphere_list,
                                  double tolerance);
 
+//returns true if the field guarantees that nothing inside the sphere is within
+//tolerance of an obstacle, in which case the spheres it bounds needn't be checked
+bool isBoundingSphereClear(const distance_field::DistanceField<distance_field::PropDistanceFieldVoxel>* distance_field,
+                           const tf::Vector3& center,
+                           double radius,
+                           double tolerance);
+
+//fills in the field and intra clearances of the merged gradient from the gradients
+//of each source, which must have been found with radii subtracted.  A saturated
+//field distance only bounds the clearance by the max distance less the radius
+void setGradientClearances(const GradientInfo& env_gradient,
+                           double max_environment_distance,
+                           const GradientInfo& self_gradient,
+                           double max_self_distance,
+                           const GradientInfo& intra_gradient,
+                           GradientInfo& gradient);
+
+//returns true if every sphere's clearance, over the fields and the other spheres, is more than margin
+bool areSpheresOutsideMargin(const std::vector<GradientInfo>& gradients, double margin);
+
+//returns true if the clearances at both ends of a segment cover each sphere's bounded
+//travel along it.  Pairs in the group are covered against the travel of both spheres,
+//taking the other sphere's at the largest travel of any
+bool areSweptSpheresCovered(const std::vector<GradientInfo>& gradients_1,
+                            const std::vector<GradientInfo>& gradients_2,
+                            const std::vector<std::vector<double> >& travel_bounds,
+                            double tolerance);
+
 //forward declaration required for friending apparently
 class BodyDecompositionVector;
 
@@ -134,7 +216,14 @@ class BodyDecomposition {
 
 public:
     
-  BodyDecomposition(const std::string& object_name, const shapes::Shape* shape, double resolution, double padding = 0.01);
+  BodyDecomposition(const std::string& object_name, const shapes::Shape* shape, double resolution, double padding = 0.01,
+                    const SphereDecompositionParameters& sphere_parameters = SphereDecompositionParameters());
+
+  //builds the decomposition from previously computed spheres and points
+  BodyDecomposition(const std::string& object_name, const shapes::Shape* shape, double padding,
+                    const tf::Transform& relative_cylinder_pose,
+                    const std::vector<CollisionSphere>& collision_spheres,
+                    const std::vector<tf::Vector3>& relative_collision_points);
 
   ~BodyDecomposition();
 
@@ -157,6 +246,28 @@ public:
     return posed_collision_points_;
   }
 
+  const std::vector<tf::Vector3>& getRelativeCollisionPoints() const
+  {
+    return relative_collision_points_;
+  }
+
+  //sphere enclosing all the collision spheres at the current pose
+  const tf::Vector3& getBoundingSphereCenter() const
+  {
+    return bounding_sphere_center_;
+  }
+
+  double getBoundingSphereRadius() const
+  {
+    return bounding_sphere_radius_;
+  }
+
+  //bounding sphere center relative to the cylinder pose, like the sphere relative_vec_
+  const tf::Vector3& getRelativeBoundingSphereCenter() const
+  {
+    return relative_bounding_sphere_center_;
+  }
+
   const bodies::Body* getBody() const
   {
     return body_;
@@ -171,6 +282,12 @@ private:
   std::vector<CollisionSphere> collision_spheres_;
   std::vector<tf::Vector3> relative_collision_points_;
   std::vector<tf::Vector3> posed_collision_points_;
+
+  tf::Vector3 relative_bounding_sphere_center_;
+  tf::Vector3 bounding_sphere_center_;
+  double bounding_sphere_radius_;
+
+  void computeBoundingSphere();
     
 };
 
@@ -258,6 +375,39 @@ private:
   std::vector<tf::Vector3> collision_points_;
 };
 
+//a distance field around a single rigid body, built in the body's own
+//frame so it stays valid however the body is posed
+class LocalDistanceField
+{
+public:
+
+  LocalDistanceField(const std::vector<tf::Vector3>& relative_points, double resolution, double max_distance);
+
+  ~LocalDistanceField();
+
+  //returns the distance and gradient for a point in the body frame,
+  //points outside the field are at least max_distance away
+  double getDistanceGradient(const tf::Vector3& point, tf::Vector3& gradient) const;
+
+  //sphere containing all the body points in the body frame
+  const tf::Vector3& getBoundingCenter() const
+  {
+    return bounding_center_;
+  }
+
+  double getBoundingRadius() const
+  {
+    return bounding_radius_;
+  }
+
+private:
+
+  distance_field::PropagationDistanceField* distance_field_;
+  double max_distance_;
+  tf::Vector3 bounding_center_;
+  double bounding_radius_;
+};
+
 struct ProximityInfo 
 {
   std::string link_name;
@@ -0,0 +1,125 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+#ifndef GRADIENT_CACHE_
+#define GRADIENT_CACHE_
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <collision_proximity/collision_proximity_types.h>
+
+namespace collision_proximity
+{
+
+//least recently used cache of state gradients keyed by the joint values
+//rounded to a quantization step.  Entries belong to a generation that
+//is advanced whenever the scene or group changes, and lookups are thread safe
+class GradientCache
+{
+public:
+
+  GradientCache();
+
+  //a max_size of zero disables the cache
+  void setParameters(unsigned int max_size, double quantization);
+
+  bool isEnabled() const {
+    return max_size_ > 0;
+  }
+
+  unsigned int getGeneration() const;
+
+  //returns true and fills in the gradients if the joint values have an entry
+  bool lookup(const std::vector<double>& joint_values,
+              bool subtract_radii,
+              std::vector<GradientInfo>& gradients,
+              bool& in_collision);
+
+  //stores the gradients unless the generation has moved on since they were computed
+  void insert(unsigned int generation,
+              const std::vector<double>& joint_values,
+              bool subtract_radii,
+              const std::vector<GradientInfo>& gradients,
+              bool in_collision);
+
+  //drops all entries and starts a new generation
+  void invalidate();
+
+  unsigned long getHits() const;
+
+  unsigned long getMisses() const;
+
+private:
+
+  struct Key {
+    bool subtract_radii;
+    std::vector<long> joint_values;
+
+    bool operator<(const Key& other) const {
+      if(subtract_radii != other.subtract_radii) {
+        return subtract_radii < other.subtract_radii;
+      }
+      return joint_values < other.joint_values;
+    }
+  };
+
+  struct Entry {
+    std::vector<GradientInfo> gradients;
+    bool in_collision;
+    std::list<Key>::iterator use_position;
+  };
+
+  Key makeKey(const std::vector<double>& joint_values, bool subtract_radii) const;
+
+  unsigned int max_size_;
+  double quantization_;
+  unsigned int generation_;
+  unsigned long hits_;
+  unsigned long misses_;
+
+  //most recently used keys at the front
+  std::list<Key> use_order_;
+  std::map<Key, Entry> entries_;
+  mutable boost::mutex mutex_;
+};
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+#ifndef COLLISION_PROXIMITY_SPHERE_DISTANCE_KERNEL_
+#define COLLISION_PROXIMITY_SPHERE_DISTANCE_KERNEL_
+
+#include <vector>
+#include <collision_proximity/collision_proximity_types.h>
+
+namespace collision_proximity
+{
+
+//sphere centers and radii stored as separate float arrays so that blocks of
+//sphere pairs can be evaluated several at a time.  The arrays are padded to a
+//multiple of SPHERE_BLOCK_WIDTH with spheres far enough away to never be closest
+struct SphereBlock
+{
+  SphereBlock() :
+    size(0)
+  {}
+
+  void setSpheres(const std::vector<CollisionSphere>& spheres);
+
+  unsigned int size;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> radius;
+};
+
+static const unsigned int SPHERE_BLOCK_WIDTH = 4;
+
+//the closest sphere in the other block for every row (sphere of the first
+//block) and every column (sphere of the second block)
+struct SphereBlockDistances
+{
+  std::vector<float> row_distances;
+  std::vector<unsigned int> row_closest;
+  std::vector<float> column_distances;
+  std::vector<unsigned int> column_closest;
+};
+
+//computes the distance between every pair of spheres in the two blocks,
+//keeping only the minimum and its index per row and per column.  With
+//subtract_radii the distances are between sphere surfaces instead of centers.
+//Distances are in float precision, so callers wanting exact values should
+//recompute them for the returned pairs
+void computeSphereBlockDistances(const SphereBlock& rows,
+                                 const SphereBlock& columns,
+                                 bool subtract_radii,
+                                 SphereBlockDistances& distances);
+
+//returns true if any sphere of the rows is within tolerance of one of the columns,
+//surface to surface.  Rows the kernel puts near the tolerance are checked again in
+//double, so the result is exact.  The blocks must hold the given spheres
+bool areSphereBlocksInCollision(const std::vector<CollisionSphere>& row_spheres,
+                                const SphereBlock& rows,
+                                const std::vector<CollisionSphere>& column_spheres,
+                                const SphereBlock& columns,
+                                double tolerance,
+                                SphereBlockDistances& distances);
+
+//lowers the distance and gradient of every sphere in either set to those of the
+//closest sphere in the other, recomputing the distances in double.  Returns true if,
+//with radii subtracted, a row sphere is within tolerance of its closest column sphere
+bool updateSphereBlockGradients(const std::vector<CollisionSphere>& row_spheres,
+                                const SphereBlock& rows,
+                                const std::vector<CollisionSphere>& column_spheres,
+                                const SphereBlock& columns,
+                                bool subtract_radii,
+                                double tolerance,
+                                GradientInfo& row_gradient,
+                                GradientInfo& column_gradient,
+                                SphereBlockDistances& distances);
+
+}
+
+#endif
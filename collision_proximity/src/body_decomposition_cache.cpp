@@ -0,0 +1,231 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/** \author E. Gil Jones */
+
+#include <fstream>
+#include <ros/ros.h>
+#include <collision_proximity/body_decomposition_cache.h>
+
+using namespace collision_proximity;
+
+namespace 
+{
+
+const char CACHE_FILE_MAGIC[4] = {'C','P','B','D'};
+const unsigned int CACHE_FILE_VERSION = 1;
+//keys are shape descriptions, so anything longer than this is corruption
+const unsigned int MAX_KEY_LENGTH = 1 << 20;
+const std::streamoff SPHERE_SIZE = 4*sizeof(double);
+const std::streamoff POINT_SIZE = 3*sizeof(double);
+
+template<typename T>
+void writeValue(std::ofstream& out, const T& val)
+{
+  out.write(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::ifstream& in, T& val)
+{
+  in.read(reinterpret_cast<char*>(&val), sizeof(T));
+  return in.good();
+}
+
+void writeVector3(std::ofstream& out, const tf::Vector3& vec)
+{
+  writeValue(out, (double)vec.x());
+  writeValue(out, (double)vec.y());
+  writeValue(out, (double)vec.z());
+}
+
+//bytes left to read, or -1 if the stream is bad
+std::streamoff remainingBytes(std::ifstream& in, std::streamoff file_size)
+{
+  std::streamoff pos = in.tellg();
+  if(pos < 0) {
+    return -1;
+  }
+  return file_size-pos;
+}
+
+bool readVector3(std::ifstream& in, tf::Vector3& vec)
+{
+  double x, y, z;
+  if(!readValue(in, x) || !readValue(in, y) || !readValue(in, z)) {
+    return false;
+  }
+  vec.setValue(x, y, z);
+  return true;
+}
+
+}
+
+BodyDecomposition* BodyDecompositionCache::createBodyDecomposition(const std::string& key,
+                                                                   const std::string& object_name,
+                                                                   const shapes::Shape* shape,
+                                                                   double padding) const
+{
+  std::map<std::string, Entry>::const_iterator it = entries_.find(key);
+  if(it == entries_.end()) {
+    return NULL;
+  }
+  return new BodyDecomposition(object_name, shape, padding, 
+                               it->second.relative_cylinder_pose,
+                               it->second.collision_spheres,
+                               it->second.relative_collision_points);
+}
+
+void BodyDecompositionCache::addBodyDecomposition(const std::string& key, const BodyDecomposition* bd)
+{
+  Entry& entry = entries_[key];
+  entry.relative_cylinder_pose = bd->relative_cylinder_pose_;
+  entry.collision_spheres = bd->getCollisionSpheres();
+  entry.relative_collision_points = bd->getRelativeCollisionPoints();
+  modified_ = true;
+}
+
+bool BodyDecompositionCache::load(const std::string& filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  if(!in.is_open()) {
+    ROS_DEBUG_STREAM("No body decomposition cache at " << filename);
+    return false;
+  }
+  in.seekg(0, std::ios::end);
+  std::streamoff file_size = in.tellg();
+  in.seekg(0, std::ios::beg);
+  char magic[4];
+  unsigned int version, num_entries;
+  in.read(magic, 4);
+  if(!in.good() || !std::equal(magic, magic+4, CACHE_FILE_MAGIC) || 
+     !readValue(in, version) || version != CACHE_FILE_VERSION ||
+     !readValue(in, num_entries)) {
+    ROS_WARN_STREAM("Body decomposition cache " << filename << " has an unrecognized format, ignoring");
+    return false;
+  }
+  //sizes read from the file are checked against what's left of it before anything is allocated
+  std::map<std::string, Entry> entries;
+  bool corrupt = false;
+  for(unsigned int i = 0; i < num_entries && !corrupt; i++) {
+    unsigned int key_length;
+    if(!readValue(in, key_length)) break;
+    if(key_length > MAX_KEY_LENGTH || (std::streamoff)key_length > remainingBytes(in, file_size)) {
+      corrupt = true;
+      break;
+    }
+    std::string key(key_length, ' ');
+    in.read(&key[0], key_length);
+    Entry& entry = entries[key];
+    tf::Vector3 rows[3], origin;
+    if(!readVector3(in, rows[0]) || !readVector3(in, rows[1]) || !readVector3(in, rows[2]) || !readVector3(in, origin)) break;
+    entry.relative_cylinder_pose.setBasis(tf::Matrix3x3(rows[0].x(), rows[0].y(), rows[0].z(),
+                                                        rows[1].x(), rows[1].y(), rows[1].z(),
+                                                        rows[2].x(), rows[2].y(), rows[2].z()));
+    entry.relative_cylinder_pose.setOrigin(origin);
+    unsigned int num_spheres;
+    if(!readValue(in, num_spheres)) break;
+    if((std::streamoff)num_spheres*SPHERE_SIZE > remainingBytes(in, file_size)) {
+      corrupt = true;
+      break;
+    }
+    entry.collision_spheres.reserve(num_spheres);
+    for(unsigned int j = 0; j < num_spheres; j++) {
+      tf::Vector3 rel;
+      double radius;
+      if(!readVector3(in, rel) || !readValue(in, radius)) break;
+      entry.collision_spheres.push_back(CollisionSphere(rel, radius));
+    }
+    unsigned int num_points;
+    if(!readValue(in, num_points)) break;
+    if((std::streamoff)num_points*POINT_SIZE > remainingBytes(in, file_size)) {
+      corrupt = true;
+      break;
+    }
+    entry.relative_collision_points.resize(num_points);
+    for(unsigned int j = 0; j < num_points; j++) {
+      if(!readVector3(in, entry.relative_collision_points[j])) break;
+    }
+  }
+  if(corrupt) {
+    ROS_WARN_STREAM("Body decomposition cache " << filename << " has sizes that don't fit in the file, ignoring");
+    return false;
+  }
+  if(!in.good()) {
+    ROS_WARN_STREAM("Body decomposition cache " << filename << " is truncated, ignoring");
+    return false;
+  }
+  entries_.swap(entries);
+  modified_ = false;
+  ROS_INFO_STREAM("Loaded " << entries_.size() << " body decompositions from " << filename);
+  return true;
+}
+
+bool BodyDecompositionCache::save(const std::string& filename)
+{
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if(!out.is_open()) {
+    ROS_WARN_STREAM("Can't open body decomposition cache " << filename << " for writing");
+    return false;
+  }
+  out.write(CACHE_FILE_MAGIC, 4);
+  writeValue(out, CACHE_FILE_VERSION);
+  writeValue(out, (unsigned int)entries_.size());
+  for(std::map<std::string, Entry>::const_iterator it = entries_.begin();
+      it != entries_.end();
+      it++) {
+    writeValue(out, (unsigned int)it->first.size());
+    out.write(it->first.c_str(), it->first.size());
+    const tf::Transform& pose = it->second.relative_cylinder_pose;
+    writeVector3(out, pose.getBasis().getRow(0));
+    writeVector3(out, pose.getBasis().getRow(1));
+    writeVector3(out, pose.getBasis().getRow(2));
+    writeVector3(out, pose.getOrigin());
+    writeValue(out, (unsigned int)it->second.collision_spheres.size());
+    for(unsigned int j = 0; j < it->second.collision_spheres.size(); j++) {
+      writeVector3(out, it->second.collision_spheres[j].relative_vec_);
+      writeValue(out, it->second.collision_spheres[j].radius_);
+    }
+    writeValue(out, (unsigned int)it->second.relative_collision_points.size());
+    for(unsigned int j = 0; j < it->second.relative_collision_points.size(); j++) {
+      writeVector3(out, it->second.relative_collision_points[j]);
+    }
+  }
+  if(!out.good()) {
+    ROS_WARN_STREAM("Failed writing body decomposition cache " << filename);
+    return false;
+  }
+  modified_ = false;
+  return true;
+}
@@ -0,0 +1,336 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+// Times the collision proximity queries for random states of a group in a
+// synthetic planning scene.  No environment server, kinematics or robot is required.
+//
+//   collision_proximity_benchmark urdf planning_description multi_dof_joints collision_checks [_param:=value ...]
+//
+// planning_environment only loads the models from the parameter server, so given
+// the robot's files the benchmark starts a master of its own on a free port and
+// loads them into it, leaving nothing to set up beforehand.  Without files it uses
+// the running master, as done by launch/collision_proximity_benchmark.launch.
+// Settings are private parameters either way, e.g. _group_name:=left_arm
+
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <ros/ros.h>
+#include <boost/lexical_cast.hpp>
+#include <collision_proximity/collision_proximity_space.h>
+#include <planning_environment/models/model_utils.h>
+
+static double gen_rand(double min, double max)
+{
+  return min+(max-min)*(rand()/(RAND_MAX+1.0));
+}
+
+struct QueryTiming
+{
+  QueryTiming() :
+    calls(0), total(0.0), min(DBL_MAX), max(0.0)
+  {}
+
+  void add(const ros::WallTime& start, const ros::WallTime& end)
+  {
+    double dur = (end-start).toSec();
+    calls++;
+    total += dur;
+    min = std::min(min, dur);
+    max = std::max(max, dur);
+  }
+
+  void print(const std::string& name) const
+  {
+    if(calls == 0) {
+      ROS_INFO_STREAM(name << ": no calls");
+      return;
+    }
+    ROS_INFO_STREAM(name << ": " << calls << " calls, av " << (total/calls)*1e6 << " us, min " << min*1e6 
+                    << " us, max " << max*1e6 << " us, " << (total > 0.0 ? calls/total : 0.0) << " queries/s");
+  }
+
+  unsigned int calls;
+  double total, min, max;
+};
+
+static int runBenchmark()
+{
+  ros::NodeHandle nh;
+  ros::NodeHandle priv("~");
+
+  std::string group_name;
+  int num_states, num_setups, num_objects, seed;
+  double scene_size;
+  priv.param("group_name", group_name, std::string("right_arm"));
+  priv.param("num_states", num_states, 10000);
+  priv.param("num_setups", num_setups, 10);
+  priv.param("num_objects", num_objects, 20);
+  priv.param("scene_size", scene_size, 1.5);
+  priv.param("seed", seed, 0);
+  srand(seed);
+
+  std::string robot_description_name = nh.resolveName("robot_description", true);
+  collision_proximity::CollisionProximitySpace cps(robot_description_name, false);
+  planning_environment::CollisionModelsInterface* cmi = cps.getCollisionModelsInterface();
+  if(!cmi->loadedModels()) {
+    ROS_ERROR_STREAM("Couldn't load models from " << robot_description_name);
+    return 1;
+  }
+  const planning_models::KinematicModel* kmodel = cmi->getKinematicModel();
+  if(!kmodel->hasModelGroup(group_name)) {
+    ROS_ERROR_STREAM("No group " << group_name << " in the planning description");
+    return 1;
+  }
+
+  //single variable joints of the group and their limits
+  std::vector<std::string> joint_names;
+  std::vector<std::pair<double, double> > joint_bounds;
+  const std::vector<const planning_models::KinematicModel::JointModel*>& joint_models = kmodel->getModelGroup(group_name)->getJointModels();
+  for(unsigned int i = 0; i < joint_models.size(); i++) {
+    std::pair<double, double> bounds;
+    if(!joint_models[i]->getVariableBounds(joint_models[i]->getName(), bounds)) {
+      ROS_INFO_STREAM("Not sampling joint " << joint_models[i]->getName());
+      continue;
+    }
+    bounds.first = std::max(bounds.first, -M_PI);
+    bounds.second = std::min(bounds.second, M_PI);
+    joint_names.push_back(joint_models[i]->getName());
+    joint_bounds.push_back(bounds);
+  }
+
+  std::vector<std::map<std::string, double> > joint_values(num_states);
+  for(int i = 0; i < num_states; i++) {
+    for(unsigned int j = 0; j < joint_names.size(); j++) {
+      joint_values[i][joint_names[j]] = gen_rand(joint_bounds[j].first, joint_bounds[j].second);
+    }
+  }
+
+  //random boxes in front of the robot, with the robot in its default state
+  arm_navigation_msgs::PlanningScene scene;
+  planning_models::KinematicState default_state(kmodel);
+  default_state.setKinematicStateToDefault();
+  planning_environment::convertKinematicStateToRobotState(default_state, ros::Time::now(), cmi->getWorldFrameId(), scene.robot_state);
+  for(int i = 0; i < num_objects; i++) {
+    arm_navigation_msgs::CollisionObject obj;
+    obj.header.stamp = ros::Time::now();
+    obj.header.frame_id = cmi->getWorldFrameId();
+    obj.id = "benchmark_box_"+boost::lexical_cast<std::string>(i);
+    obj.operation.operation = arm_navigation_msgs::CollisionObjectOperation::ADD;
+    obj.shapes.resize(1);
+    obj.shapes[0].type = arm_navigation_msgs::Shape::BOX;
+    obj.shapes[0].dimensions.resize(3);
+    for(unsigned int j = 0; j < 3; j++) {
+      obj.shapes[0].dimensions[j] = gen_rand(.05, .2);
+    }
+    obj.poses.resize(1);
+    obj.poses[0].position.x = gen_rand(0.0, scene_size);
+    obj.poses[0].position.y = gen_rand(-scene_size/2.0, scene_size/2.0);
+    obj.poses[0].position.z = gen_rand(0.0, scene_size);
+    obj.poses[0].orientation.w = 1.0;
+    scene.collision_objects.push_back(obj);
+  }
+
+  QueryTiming scene_timing, setup_timing, state_timing, gradient_timing, collision_timing;
+  ros::WallTime n1 = ros::WallTime::now();
+  if(!cps.setPlanningScene(scene)) {
+    ROS_ERROR("Couldn't set the synthetic planning scene");
+    return 1;
+  }
+  scene_timing.add(n1, ros::WallTime::now());
+
+  std::vector<std::string> link_names, attached_body_names;
+  planning_models::KinematicState* state = cmi->getPlanningSceneState();
+  planning_models::KinematicState::JointStateGroup* state_group = state->getJointStateGroup(group_name);
+  for(int i = 0; i < std::max(num_setups, 1); i++) {
+    arm_navigation_msgs::RobotState robot_state = scene.robot_state;
+    if(i != 0 && num_states > 0) {
+      state_group->setKinematicState(joint_values[i%num_states]);
+      planning_environment::convertKinematicStateToRobotState(*state, ros::Time::now(), cmi->getWorldFrameId(), robot_state);
+    }
+    n1 = ros::WallTime::now();
+    cps.setupForGroupQueries(group_name, robot_state, link_names, attached_body_names);
+    setup_timing.add(n1, ros::WallTime::now());
+  }
+
+  unsigned int num_in_collision = 0;
+  std::vector<collision_proximity::GradientInfo> gradients;
+  for(int i = 0; i < num_states; i++) {
+    state_group->setKinematicState(joint_values[i]);
+    n1 = ros::WallTime::now();
+    cps.setCurrentGroupState(*state);
+    ros::WallTime n2 = ros::WallTime::now();
+    state_timing.add(n1, n2);
+    cps.getStateGradients(gradients, true);
+    ros::WallTime n3 = ros::WallTime::now();
+    gradient_timing.add(n2, n3);
+    if(cps.isStateInCollision()) {
+      num_in_collision++;
+    }
+    collision_timing.add(n3, ros::WallTime::now());
+  }
+
+  ROS_INFO_STREAM("Group " << group_name << " with " << link_names.size() << " links, " 
+                  << num_objects << " objects, " << joint_names.size() << " sampled joints");
+  scene_timing.print("setPlanningScene");
+  setup_timing.print("setupForGroupQueries");
+  state_timing.print("setCurrentGroupState");
+  gradient_timing.print("getStateGradients");
+  collision_timing.print("isStateInCollision");
+  if(num_states > 0) {
+    ROS_INFO_STREAM("Fraction of states in collision " << (num_in_collision*1.0)/(num_states*1.0));
+  }
+
+  return 0;
+}
+
+//a port nothing is listening on right now, or 0 if none could be found
+static int findFreePort()
+{
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if(sock < 0) {
+    return 0;
+  }
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  socklen_t len = sizeof(addr);
+  int port = 0;
+  if(bind(sock, (sockaddr*)&addr, sizeof(addr)) == 0 && getsockname(sock, (sockaddr*)&addr, &len) == 0) {
+    port = ntohs(addr.sin_port);
+  }
+  close(sock);
+  return port;
+}
+
+//starts a master on the port for this process and the ones it runs, returning its pid or -1
+static pid_t startMaster(int port)
+{
+  std::string uri = "http://localhost:"+boost::lexical_cast<std::string>(port)+"/";
+  setenv("ROS_MASTER_URI", uri.c_str(), 1);
+  pid_t pid = fork();
+  if(pid == 0) {
+    std::string port_string = boost::lexical_cast<std::string>(port);
+    freopen("/dev/null", "w", stdout);
+    freopen("/dev/null", "w", stderr);
+    execlp("rosmaster", "rosmaster", "--core", "-p", port_string.c_str(), (char*)NULL);
+    _exit(1);
+  }
+  return pid;
+}
+
+static bool loadParameterFile(const std::string& file, const std::string& ns)
+{
+  std::string command = "rosparam load '"+file+"' "+ns;
+  return (system(command.c_str()) == 0);
+}
+
+static void stopMaster(pid_t pid)
+{
+  if(pid > 0) {
+    kill(pid, SIGINT);
+    waitpid(pid, NULL, 0);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  //the robot's files are the arguments that aren't ros remappings or parameters
+  std::vector<std::string> files;
+  for(int i = 1; i < argc; i++) {
+    if(std::string(argv[i]).find(":=") == std::string::npos) {
+      files.push_back(argv[i]);
+    }
+  }
+  if(!files.empty() && files.size() != 4) {
+    std::cerr << "Usage: " << argv[0] << " [urdf planning_description multi_dof_joints collision_checks] [_param:=value ...]" << std::endl;
+    return 1;
+  }
+  pid_t master_pid = -1;
+  if(!files.empty()) {
+    int port = findFreePort();
+    if(port == 0 || (master_pid = startMaster(port)) < 0) {
+      std::cerr << "Couldn't start a master for the benchmark" << std::endl;
+      return 1;
+    }
+  }
+
+  ros::init(argc, argv, "collision_proximity_benchmark", ros::init_options::NoRosout);
+
+  if(master_pid > 0) {
+    ros::WallTime start = ros::WallTime::now();
+    while(!ros::master::check()) {
+      if(ros::WallTime::now()-start > ros::WallDuration(10.0)) {
+        ROS_ERROR("The benchmark's master didn't start");
+        stopMaster(master_pid);
+        return 1;
+      }
+      ros::WallDuration(0.1).sleep();
+    }
+    ros::NodeHandle nh;
+    std::ifstream urdf_file(files[0].c_str());
+    if(!urdf_file) {
+      ROS_ERROR_STREAM("Couldn't read " << files[0]);
+      stopMaster(master_pid);
+      return 1;
+    }
+    std::stringstream urdf;
+    urdf << urdf_file.rdbuf();
+    nh.setParam("robot_description", urdf.str());
+    if(!loadParameterFile(files[1], "robot_description_planning") ||
+       !loadParameterFile(files[2], "robot_description_planning") ||
+       !loadParameterFile(files[3], "robot_description_collision")) {
+      ROS_ERROR("Couldn't load the planning and collision parameters");
+      stopMaster(master_pid);
+      return 1;
+    }
+  }
+  int ret = runBenchmark();
+  ros::shutdown();
+  stopMaster(master_pid);
+  return ret;
+}
@@ -0,0 +1,200 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+#include <sstream>
+#include <algorithm>
+#include <collision_proximity/collision_proximity_profiler.h>
+
+using namespace collision_proximity;
+
+CollisionProximityProfiler::CollisionProximityProfiler() :
+  enabled_(false),
+  histograms_(NUM_TIMERS),
+  counters_(NUM_COUNTERS, 0)
+{
+}
+
+void CollisionProximityProfiler::addTime(Timer timer, double seconds)
+{
+  if(!enabled_) {
+    return;
+  }
+  unsigned int bucket = 0;
+  double upper = 1e-6;
+  while(seconds >= upper && bucket < NUM_BUCKETS-1) {
+    bucket++;
+    upper *= 2.0;
+  }
+  boost::mutex::scoped_lock lock(mutex_);
+  Histogram& hist = histograms_[timer];
+  if(hist.calls == 0 || seconds < hist.min) {
+    hist.min = seconds;
+  }
+  if(hist.calls == 0 || seconds > hist.max) {
+    hist.max = seconds;
+  }
+  hist.calls++;
+  hist.total += seconds;
+  hist.buckets[bucket]++;
+}
+
+void CollisionProximityProfiler::addCount(Counter counter, unsigned long count)
+{
+  if(!enabled_) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(mutex_);
+  counters_[counter] += count;
+}
+
+void CollisionProximityProfiler::reset()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  histograms_.assign(NUM_TIMERS, Histogram());
+  counters_.assign(NUM_COUNTERS, 0);
+}
+
+static void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, double value)
+{
+  std::stringstream ss;
+  ss << value;
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = ss.str();
+  status.values.push_back(kv);
+}
+
+void CollisionProximityProfiler::getDiagnostics(std::vector<diagnostic_msgs::DiagnosticStatus>& statuses) const
+{
+  statuses.clear();
+  boost::mutex::scoped_lock lock(mutex_);
+  for(unsigned int i = 0; i < NUM_TIMERS; i++) {
+    const Histogram& hist = histograms_[i];
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = "collision_proximity: "+getTimerName((Timer)i);
+    std::stringstream ss;
+    ss << hist.calls << " calls";
+    status.message = ss.str();
+    addValue(status, "calls", hist.calls);
+    addValue(status, "total (s)", hist.total);
+    addValue(status, "mean (ms)", hist.calls == 0 ? 0.0 : hist.total*1000.0/hist.calls);
+    addValue(status, "min (ms)", hist.min*1000.0);
+    addValue(status, "max (ms)", hist.max*1000.0);
+    //reported as the upper edge of the bucket each percentile falls in
+    double percentiles[3] = {0.5, 0.9, 0.99};
+    std::string percentile_names[3] = {"p50 (ms)", "p90 (ms)", "p99 (ms)"};
+    for(unsigned int j = 0; j < 3; j++) {
+      unsigned long target = (unsigned long)(percentiles[j]*hist.calls);
+      unsigned long sum = 0;
+      double upper = 1e-6;
+      double value = hist.max;
+      for(unsigned int k = 0; k < NUM_BUCKETS-1; k++, upper *= 2.0) {
+        sum += hist.buckets[k];
+        if(sum > target) {
+          value = std::min(upper, hist.max);
+          break;
+        }
+      }
+      addValue(status, percentile_names[j], value*1000.0);
+    }
+    std::stringstream hs;
+    double upper = 1e-6;
+    for(unsigned int k = 0; k < NUM_BUCKETS; k++, upper *= 2.0) {
+      if(hist.buckets[k] == 0) continue;
+      if(hs.tellp() > 0) hs << " ";
+      if(k == NUM_BUCKETS-1) {
+        hs << ">=" << upper*500000.0 << "us:" << hist.buckets[k];
+      } else {
+        hs << "<" << upper*1000000.0 << "us:" << hist.buckets[k];
+      }
+    }
+    diagnostic_msgs::KeyValue kv;
+    kv.key = "histogram";
+    kv.value = hs.str();
+    status.values.push_back(kv);
+    statuses.push_back(status);
+  }
+  diagnostic_msgs::DiagnosticStatus status;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.name = "collision_proximity: counters";
+  status.message = "Query counters";
+  for(unsigned int i = 0; i < NUM_COUNTERS; i++) {
+    addValue(status, getCounterName((Counter)i), counters_[i]);
+  }
+  statuses.push_back(status);
+}
+
+std::string CollisionProximityProfiler::getTimerName(Timer timer)
+{
+  switch(timer) {
+  case SETUP_GROUP_QUERIES:
+    return "setup group queries";
+  case ENVIRONMENT_FIELD:
+    return "environment field";
+  case SELF_FIELD:
+    return "self field";
+  case SET_GROUP_STATE:
+    return "set group state";
+  case STATE_GRADIENTS:
+    return "state gradients";
+  case STATE_COLLISION:
+    return "state collision";
+  case TRAJECTORY_SAFETY:
+    return "trajectory safety";
+  default:
+    return "unknown";
+  }
+}
+
+std::string CollisionProximityProfiler::getCounterName(Counter counter)
+{
+  switch(counter) {
+  case SPHERES_EVALUATED:
+    return "spheres evaluated";
+  case SPHERE_PAIRS_EVALUATED:
+    return "sphere pairs evaluated";
+  case FIELD_LOOKUPS:
+    return "field lookups";
+  case GRADIENT_CACHE_HITS:
+    return "gradient cache hits";
+  case GRADIENT_CACHE_MISSES:
+    return "gradient cache misses";
+  default:
+    return "unknown";
+  }
+}
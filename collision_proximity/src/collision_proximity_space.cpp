@@ -39,6 +39,9 @@
 #include <planning_environment/models/model_utils.h>
 #include <collision_proximity/collision_proximity_space.h>
 #include <tf/tf.h>
+#include <angles/angles.h>
+#include <boost/thread.hpp>
+#include <set>
 
 using collision_proximity::CollisionProximitySpace;
 
@@ -61,8 +64,32 @@ static std::string makeAttachedObjectId(std::string link, std::string object)
   return link+"_"+object;
 }
 
+static bool areConstraintsEmpty(const arm_navigation_msgs::Constraints& constraints)
+{
+  return (constraints.joint_constraints.empty() && constraints.position_constraints.empty() &&
+          constraints.orientation_constraints.empty() && constraints.visibility_constraints.empty());
+}
+
+//identifies the shapes of a namespace in their current poses
+static std::string makeStaticObjectSignature(const collision_space::EnvironmentObjects::NamespaceObjects& no,
+                                             const tf::Transform& inv)
+{
+  std::stringstream ss;
+  ss.precision(17);
+  for(unsigned int i = 0; i < no.shape.size(); i++) {
+    tf::Transform pose = inv*no.shape_pose[i];
+    ss << collision_proximity::computeShapeHash(no.shape[i]) << " "
+       << pose.getOrigin().x() << " " << pose.getOrigin().y() << " " << pose.getOrigin().z() << " "
+       << pose.getRotation().x() << " " << pose.getRotation().y() << " " << pose.getRotation().z() << " "
+       << pose.getRotation().w() << ";";
+  }
+  return ss.str();
+}
+
 CollisionProximitySpace::CollisionProximitySpace(const std::string& robot_description_name,
                                                  bool register_with_environment_server, bool use_signed_environment_field , bool use_signed_self_field) :
+  use_signed_environment_field_(use_signed_environment_field),
+  use_signed_self_field_(use_signed_self_field),
   priv_handle_("~")
 {
   collision_models_interface_ = new planning_environment::CollisionModelsInterface(robot_description_name,
@@ -80,9 +107,69 @@ CollisionProximitySpace::CollisionProximitySpace(const std::string& robot_descri
   priv_handle_.param("max_self_distance", max_self_distance_, 0.1);
   priv_handle_.param("undefined_distance", undefined_distance_, 1.0);
 
+  std::string sphere_decomposition_method;
+  int max_spheres;
+  priv_handle_.param("sphere_decomposition_method", sphere_decomposition_method, std::string("cylinder"));
+  priv_handle_.param("sphere_decomposition_max_error", sphere_decomposition_parameters_.max_error, 0.01);
+  priv_handle_.param("sphere_decomposition_max_spheres", max_spheres, 20);
+  sphere_decomposition_parameters_.max_spheres = std::max(max_spheres, 1);
+  if(sphere_decomposition_method == "greedy") {
+    sphere_decomposition_parameters_.method = SphereDecompositionParameters::GREEDY_COVER;
+  } else if(sphere_decomposition_method != "cylinder") {
+    ROS_WARN_STREAM("Unknown sphere decomposition method " << sphere_decomposition_method << ", using cylinder");
+  }
+  priv_handle_.param("body_decomposition_cache_file", body_decomposition_cache_file_, std::string(""));
+  int object_decomposition_cache_size;
+  priv_handle_.param("object_decomposition_cache_size", object_decomposition_cache_size, 256);
+  object_decomposition_cache_size_ = std::max(object_decomposition_cache_size, 0);
+  priv_handle_.param("use_link_local_self_fields", use_link_local_self_fields_, false);
+  int swept_sphere_max_depth;
+  priv_handle_.param("use_swept_sphere_checking", use_swept_sphere_checking_, false);
+  priv_handle_.param("swept_sphere_max_depth", swept_sphere_max_depth, 6);
+  swept_sphere_max_depth_ = std::max(swept_sphere_max_depth, 0);
+  int trajectory_safety_threads;
+  priv_handle_.param("trajectory_safety_threads", trajectory_safety_threads, 1);
+  trajectory_safety_threads_ = std::max(trajectory_safety_threads, 1);
+  priv_handle_.param("trajectory_safety_margin", trajectory_safety_margin_, 0.0);
+  //cylinder decompositions leave the ends of the body past the end spheres, so
+  //only a greedy cover bounds the body closely enough to skip the mesh check
+  if(trajectory_safety_margin_ > 0.0 && sphere_decomposition_parameters_.method != SphereDecompositionParameters::GREEDY_COVER) {
+    ROS_WARN_STREAM("Trajectory safety margin needs the greedy sphere decomposition method, not skipping mesh checks");
+    trajectory_safety_margin_ = 0.0;
+  }
+  //a saturated field proves no more than its max distance less the radius, so a
+  //margin at or past it could never clear a point
+  if(trajectory_safety_margin_ >= std::min(max_environment_distance_, max_self_distance_)) {
+    ROS_WARN_STREAM("Trajectory safety margin " << trajectory_safety_margin_ << " is not below the max field distance "
+                    << std::min(max_environment_distance_, max_self_distance_) << ", not skipping mesh checks");
+    trajectory_safety_margin_ = 0.0;
+  }
+  if(trajectory_safety_margin_ > 0.0 && trajectory_safety_margin_ < resolution_) {
+    ROS_WARN_STREAM("Trajectory safety margin " << trajectory_safety_margin_ << " is below the field resolution " << resolution_);
+  }
+  int gradient_cache_size;
+  double gradient_cache_quantization;
+  priv_handle_.param("gradient_cache_size", gradient_cache_size, 0);
+  priv_handle_.param("gradient_cache_quantization", gradient_cache_quantization, 1e-5);
+  if(gradient_cache_quantization <= 0.0) {
+    ROS_WARN_STREAM("Gradient cache quantization must be positive, using 1e-5");
+    gradient_cache_quantization = 1e-5;
+  }
+  gradient_cache_.setParameters(std::max(gradient_cache_size, 0), gradient_cache_quantization);
+  bool enable_profiling;
+  double profiling_publish_period;
+  priv_handle_.param("enable_profiling", enable_profiling, false);
+  priv_handle_.param("profiling_publish_period", profiling_publish_period, 5.0);
+  profiler_.setEnabled(enable_profiling);
+
   vis_distance_field_marker_publisher_ = root_handle_.advertise<visualization_msgs::Marker>("visualization_marker", 128);
   vis_marker_publisher_ = root_handle_.advertise<visualization_msgs::Marker>("collision_proximity_body_spheres", 128);
   vis_marker_array_publisher_ = root_handle_.advertise<visualization_msgs::MarkerArray>("collision_proximity_body_spheres_array", 128);
+  if(enable_profiling) {
+    diagnostics_publisher_ = root_handle_.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
+    profiling_timer_ = root_handle_.createWallTimer(ros::WallDuration(profiling_publish_period), 
+                                                    &CollisionProximitySpace::publishProfilingDiagnostics, this);
+  }
 
   if(use_signed_self_field)
   {
@@ -100,6 +187,9 @@ CollisionProximitySpace::CollisionProximitySpace(const std::string& robot_descri
   {
     environment_distance_field_ = new distance_field::PropagationDistanceField(size_x_, size_y_, size_z_, resolution_, origin_x_, origin_y_, origin_z_, max_environment_distance_);
   }
+  //fields are updated incrementally, so they need to start out empty
+  self_distance_field_->reset();
+  environment_distance_field_->reset();
 
   collision_models_interface_->addSetPlanningSceneCallback(boost::bind(&CollisionProximitySpace::setPlanningSceneCallback, this, _1));
   collision_models_interface_->addRevertPlanningSceneCallback(boost::bind(&CollisionProximitySpace::revertPlanningSceneCallback, this));
@@ -131,6 +221,11 @@ CollisionProximitySpace::~CollisionProximitySpace()
       it++) {
     delete it->second;
   }
+  for(std::map<std::string, LocalDistanceField*>::iterator it = local_distance_field_map_.begin();
+      it != local_distance_field_map_.end();
+      it++) {
+    delete it->second;
+  }
   deleteAllStaticObjectDecompositions();
   deleteAllAttachedObjectDecompositions();
 }
@@ -143,6 +238,7 @@ void CollisionProximitySpace::deleteAllStaticObjectDecompositions()
     delete it->second;
   }
   static_object_map_.clear();
+  static_object_signatures_.clear();
 }
 
 void CollisionProximitySpace::deleteAllAttachedObjectDecompositions()
@@ -158,6 +254,14 @@ void CollisionProximitySpace::deleteAllAttachedObjectDecompositions()
   current_attached_body_indices_.clear();
 }
 
+void CollisionProximitySpace::publishProfilingDiagnostics(const ros::WallTimerEvent& event)
+{
+  diagnostic_msgs::DiagnosticArray arr;
+  arr.header.stamp = ros::Time::now();
+  profiler_.getDiagnostics(arr.status);
+  diagnostics_publisher_.publish(arr);
+}
+
 void CollisionProximitySpace::loadDefaultCollisionOperations()
 {
   std::map<std::string, bool> all_true_map;
@@ -249,6 +353,10 @@ void CollisionProximitySpace::loadDefaultCollisionOperations()
 void CollisionProximitySpace::loadRobotBodyDecompositions()
 {
   const planning_models::KinematicModel* kmodel = collision_models_interface_->getKinematicModel();
+
+  if(!body_decomposition_cache_file_.empty()) {
+    body_decomposition_cache_.load(body_decomposition_cache_file_);
+  }
   
   for(unsigned int i = 0; i < kmodel->getLinkModels().size(); i++) {
     if(kmodel->getLinkModels()[i]->getLinkShape() != NULL) {
@@ -260,11 +368,20 @@ void CollisionProximitySpace::loadRobotBodyDecompositions()
         padding = collision_models_interface_->getDefaultLinkPaddingMap().at(kmodel->getLinkModels()[i]->getName());
       }
 
-      body_decomposition_map_[kmodel->getLinkModels()[i]->getName()] = new BodyDecomposition(kmodel->getLinkModels()[i]->getName(),
-                                                                                             kmodel->getLinkModels()[i]->getLinkShape(),
-                                                                                             resolution_/2.0, padding);
+      const std::string& link_name = kmodel->getLinkModels()[i]->getName();
+      const shapes::Shape* shape = kmodel->getLinkModels()[i]->getLinkShape();
+      std::string key = makeBodyDecompositionKey(shape, resolution_/2.0, padding, sphere_decomposition_parameters_);
+      BodyDecomposition* bd = body_decomposition_cache_.createBodyDecomposition(key, link_name, shape, padding);
+      if(bd == NULL) {
+        bd = new BodyDecomposition(link_name, shape, resolution_/2.0, padding, sphere_decomposition_parameters_);
+        body_decomposition_cache_.addBodyDecomposition(key, bd);
+      }
+      body_decomposition_map_[link_name] = bd;
     }
   }
+  if(!body_decomposition_cache_file_.empty() && body_decomposition_cache_.isModified()) {
+    body_decomposition_cache_.save(body_decomposition_cache_file_);
+  }
 }
 
 bool CollisionProximitySpace::setPlanningScene(const arm_navigation_msgs::PlanningScene& scene) {
@@ -274,7 +391,8 @@ bool CollisionProximitySpace::setPlanningScene(const arm_navigation_msgs::Planni
 void CollisionProximitySpace::setPlanningSceneCallback(const arm_navigation_msgs::PlanningScene& scene) 
 {
   ros::WallTime n1 = ros::WallTime::now();
-  deleteAllStaticObjectDecompositions();
+  gradient_cache_.invalidate();
+  //static objects are kept if they haven't changed
   deleteAllAttachedObjectDecompositions();
 
   syncObjectsWithCollisionSpace(*collision_models_interface_->getPlanningSceneState());
@@ -289,7 +407,10 @@ void CollisionProximitySpace::setupForGroupQueries(const std::string& group_name
                                                    std::vector<std::string>& link_names,
                                                    std::vector<std::string>& attached_body_names)
 {
+  ScopedProfileTimer profile_timer(profiler_, CollisionProximityProfiler::SETUP_GROUP_QUERIES);
   ros::WallTime n1 = ros::WallTime::now();
+  //the rest of the robot may have moved, so nothing cached still holds
+  gradient_cache_.invalidate();
   //setting up current info
   current_group_name_ = group_name;
   //for trajectory safety check
@@ -365,6 +486,7 @@ void CollisionProximitySpace::setupForGroupQueries(const std::string& group_name
     }
   }
   setBodyPosesGivenKinematicState(*collision_models_interface_->getPlanningSceneState());
+  setGroupStateContext(*collision_models_interface_->getPlanningSceneState(), current_context_);
   setDistanceFieldForGroupQueries(current_group_name_, *collision_models_interface_->getPlanningSceneState());
   ros::WallTime n2 = ros::WallTime::now();
   ROS_DEBUG_STREAM("Setting self for group " << current_group_name_ << " took " << (n2-n1).toSec());
@@ -375,8 +497,10 @@ void CollisionProximitySpace::revertPlanningSceneCallback() {
 
   collision_models_interface_->bodiesLock();
   current_group_name_ = "";
+  gradient_cache_.invalidate();
 
-  deleteAllStaticObjectDecompositions();
+  //static objects and the environment field stay around so that the 
+  //next scene only needs to apply what's changed
   deleteAllAttachedObjectDecompositions();
   collision_models_interface_->bodiesUnlock();
 }
@@ -387,23 +511,66 @@ void CollisionProximitySpace::setCurrentGroupState(const planning_models::Kinema
   if(current_group_name_.empty()) {
     return;
   }
+  setGroupStateContext(state, current_context_);
+  ROS_DEBUG_STREAM("Group state update took " << (ros::WallTime::now()-n1).toSec());
+}
+
+void CollisionProximitySpace::setGroupStateContext(const planning_models::KinematicState& state,
+                                                   GroupStateContext& context) const
+{
+  ScopedProfileTimer profile_timer(profiler_, CollisionProximityProfiler::SET_GROUP_STATE);
+  unsigned int num_links = current_link_names_.size();
+  context.body_spheres.resize(num_links+current_attached_body_names_.size());
+  context.link_bounding_sphere_centers.resize(num_links);
+  context.gradients = current_gradients_;
+  if(gradient_cache_.isEnabled()) {
+    state.getKinematicStateValues(context.joint_values);
+  }
   tf::Transform inv = getInverseWorldTransform(state);
   for(unsigned int i = 0; i < current_link_indices_.size(); i++) {
     const planning_models::KinematicState::LinkState* ls = state.getLinkStateVector()[current_link_indices_[i]];
-    current_link_body_decompositions_[i]->updateSpheresPose(inv*ls->getGlobalCollisionBodyTransform());
+    const BodyDecomposition* bd = current_link_body_decompositions_[i];
+    tf::Transform cyl_transform = inv*ls->getGlobalCollisionBodyTransform()*bd->relative_cylinder_pose_;
+    std::vector<CollisionSphere>& spheres = context.body_spheres[i];
+    spheres = bd->getCollisionSpheres();
+    for(unsigned int j = 0; j < spheres.size(); j++) {
+      spheres[j].center_ = cyl_transform*spheres[j].relative_vec_;
+    }
+    context.link_bounding_sphere_centers[i] = cyl_transform*bd->getRelativeBoundingSphereCenter();
   }
   for(unsigned int i = 0; i < current_attached_body_indices_.size(); i++) {
     const planning_models::KinematicState::LinkState* ls = state.getLinkStateVector()[current_attached_body_indices_[i]];
+    const BodyDecompositionVector* bdv = current_attached_body_decompositions_[i];
+    std::vector<CollisionSphere>& spheres = context.body_spheres[num_links+i];
+    spheres.clear();
     for(unsigned int j = 0; j < ls->getAttachedBodyStateVector().size(); j++) {
       const planning_models::KinematicState::AttachedBodyState* att_state = ls->getAttachedBodyStateVector()[j];
-      for(unsigned int k = 0; k < att_state->getGlobalCollisionBodyTransforms().size(); k++) {
-        tf::Transform test = inv*att_state->getGlobalCollisionBodyTransforms()[k];
-        current_attached_body_decompositions_[i]->updateSpheresPose(k, inv*att_state->getGlobalCollisionBodyTransforms()[k]);
+      if(makeAttachedObjectId(ls->getName(), att_state->getName()) != current_attached_body_names_[i]) {
+        continue;
+      }
+      for(unsigned int k = 0; k < att_state->getGlobalCollisionBodyTransforms().size() && k < bdv->getSize(); k++) {
+        const BodyDecomposition* bd = bdv->getBodyDecomposition(k);
+        tf::Transform cyl_transform = inv*att_state->getGlobalCollisionBodyTransforms()[k]*bd->relative_cylinder_pose_;
+        for(unsigned int l = 0; l < bd->getCollisionSpheres().size(); l++) {
+          spheres.push_back(bd->getCollisionSpheres()[l]);
+          spheres.back().center_ = cyl_transform*spheres.back().relative_vec_;
+        }
       }
     }
   }
-  updateSphereLocations(current_link_names_, current_attached_body_names_, current_gradients_);
-  ROS_DEBUG_STREAM("Group state update took " << (ros::WallTime::now()-n1).toSec());
+  for(unsigned int i = 0; i < context.body_spheres.size() && i < context.gradients.size(); i++) {
+    const std::vector<CollisionSphere>& spheres = context.body_spheres[i];
+    context.gradients[i].sphere_locations.resize(spheres.size());
+    context.gradients[i].sphere_radii.resize(spheres.size());
+    for(unsigned int j = 0; j < spheres.size(); j++) {
+      context.gradients[i].sphere_locations[j] = spheres[j].center_;
+      context.gradients[i].sphere_radii[j] = spheres[j].radius_;
+    }
+  }
+  context.body_sphere_blocks.resize(context.body_spheres.size());
+  for(unsigned int i = 0; i < context.body_spheres.size(); i++) {
+    context.body_sphere_blocks[i].setSpheres(context.body_spheres[i]);
+  }
 }
 
 void CollisionProximitySpace::setBodyPosesGivenKinematicState(const planning_models::KinematicState& state)
@@ -451,18 +618,36 @@ void CollisionProximitySpace::syncObjectsWithCollisionSpace(const planning_model
   tf::Transform inv = getInverseWorldTransform(state);
   const collision_space::EnvironmentObjects *eo = collision_models_interface_->getCollisionSpace()->getObjects();
   std::vector<std::string> ns = eo->getNamespaces();
+  std::map<std::string, BodyDecompositionVector*> old_static_object_map;
+  old_static_object_map.swap(static_object_map_);
+  std::map<std::string, std::string> old_static_object_signatures;
+  old_static_object_signatures.swap(static_object_signatures_);
   for(unsigned int i = 0; i < ns.size(); i++) {
     if(ns[i] == COLLISION_MAP_NAME) continue;
     const collision_space::EnvironmentObjects::NamespaceObjects &no = eo->getObjects(ns[i]);
+    std::string signature = makeStaticObjectSignature(no, inv);
+    static_object_signatures_[ns[i]] = signature;
+    if(old_static_object_map.find(ns[i]) != old_static_object_map.end() &&
+       old_static_object_signatures[ns[i]] == signature) {
+      static_object_map_[ns[i]] = old_static_object_map[ns[i]];
+      old_static_object_map.erase(ns[i]);
+      continue;
+    }
     BodyDecompositionVector* bdv = new BodyDecompositionVector();
     for(unsigned int j = 0; j < no.shape.size(); j++) {
-      BodyDecomposition* bd = new BodyDecomposition(ns[i]+"_"+makeStringFromUnsignedInt(j), no.shape[j], resolution_);
+      BodyDecomposition* bd = createObjectBodyDecomposition(ns[i]+"_"+makeStringFromUnsignedInt(j), no.shape[j]);
       bd->updatePose(inv*no.shape_pose[j]);
       tf::Transform trans = bd->getBody()->getPose();
       bdv->addToVector(bd); 
     }
     static_object_map_[ns[i]] = bdv;
   }
+  //objects that were removed or changed
+  for(std::map<std::string, BodyDecompositionVector*>::iterator it = old_static_object_map.begin();
+      it != old_static_object_map.end();
+      it++) {
+    delete it->second;
+  }
   
   const std::vector<planning_models::KinematicState::LinkState*> link_states = state.getLinkStateVector();
   for(unsigned int i = 0; i < link_states.size(); i++) {
@@ -472,7 +657,7 @@ void CollisionProximitySpace::syncObjectsWithCollisionSpace(const planning_model
       const planning_models::KinematicState::AttachedBodyState* abs = ls->getAttachedBodyStateVector()[j];
       std::string id = makeAttachedObjectId(ls->getName(),abs->getName());
       for(unsigned int k = 0; k < abs->getAttachedBodyModel()->getShapes().size(); k++) {
-        BodyDecomposition* bd = new BodyDecomposition(id+makeStringFromUnsignedInt(j), abs->getAttachedBodyModel()->getShapes()[k], resolution_);
+        BodyDecomposition* bd = createObjectBodyDecomposition(id+makeStringFromUnsignedInt(j), abs->getAttachedBodyModel()->getShapes()[k]);
         bd->updatePose(inv*abs->getGlobalCollisionBodyTransforms()[k]);
         bdv->addToVector(bd);
       }
@@ -484,6 +669,28 @@ void CollisionProximitySpace::syncObjectsWithCollisionSpace(const planning_model
   }
 }
 
+BodyDecomposition* CollisionProximitySpace::createObjectBodyDecomposition(const std::string& name,
+                                                                         const shapes::Shape* shape)
+{
+  //objects get the default padding and cylinder spheres, unlike robot links
+  double padding = 0.01;
+  SphereDecompositionParameters sphere_parameters;
+  std::string key = makeBodyDecompositionKey(shape, resolution_, padding, sphere_parameters);
+  BodyDecomposition* bd = object_decomposition_cache_.createBodyDecomposition(key, name, shape, padding);
+  if(bd != NULL) {
+    return bd;
+  }
+  bd = new BodyDecomposition(name, shape, resolution_, padding, sphere_parameters);
+  if(object_decomposition_cache_size_ > 0) {
+    //cheaper than tracking use, and the cache refills with what's still around
+    if(object_decomposition_cache_.getSize() >= object_decomposition_cache_size_) {
+      object_decomposition_cache_.clear();
+    }
+    object_decomposition_cache_.addBodyDecomposition(key, bd);
+  }
+  return bd;
+}
+
 void CollisionProximitySpace::setDistanceFieldForGroupQueries(const std::string& group_name,
                                                               const planning_models::KinematicState& state)
 {
@@ -504,21 +711,36 @@ void CollisionProximitySpace::setDistanceFieldForGroupQueries(const std::string&
 
 void CollisionProximitySpace::prepareEnvironmentDistanceField(const planning_models::KinematicState& state)
 {
-  environment_distance_field_->reset();
+  ScopedProfileTimer profile_timer(profiler_, CollisionProximityProfiler::ENVIRONMENT_FIELD);
+  std::map<std::string, std::vector<tf::Vector3> > field_points;
   tf::Transform inv = getInverseWorldTransform(state);
-  std::vector<tf::Vector3> all_points;
   for(std::map<std::string, BodyDecompositionVector*>::iterator it = static_object_map_.begin();
       it != static_object_map_.end();
       it++) {
+    std::vector<tf::Vector3>& obj_points = field_points[it->first];
     for(unsigned int i = 0; i < it->second->getSize(); i++) {
-      std::vector<tf::Vector3> obj_points = it->second->getBodyDecomposition(i)->getCollisionPoints();
-      all_points.insert(all_points.end(),obj_points.begin(), obj_points.end());
+      const std::vector<tf::Vector3>& body_points = it->second->getBodyDecomposition(i)->getCollisionPoints();
+      obj_points.insert(obj_points.end(), body_points.begin(), body_points.end());
     }
   }
+  std::vector<tf::Vector3>& map_points = field_points[COLLISION_MAP_NAME];
   for(unsigned int i = 0; i < collision_models_interface_->getCollisionMapPoses().size(); i++) {
-    all_points.push_back(inv*collision_models_interface_->getCollisionMapPoses()[i].getOrigin());
+    map_points.push_back(inv*collision_models_interface_->getCollisionMapPoses()[i].getOrigin());
+  }
+  //the same objects in the same poses with the same collision map
+  if(field_points == environment_distance_field_points_) {
+    ROS_DEBUG_STREAM("Environment distance field unchanged");
+    return;
   }
-  environment_distance_field_->addPointsToField(all_points);
+  //the field works out which voxels were added or removed
+  std::vector<tf::Vector3> all_points;
+  for(std::map<std::string, std::vector<tf::Vector3> >::iterator it = field_points.begin();
+      it != field_points.end();
+      it++) {
+    all_points.insert(all_points.end(), it->second.begin(), it->second.end());
+  }
+  updateDistanceFieldPoints(environment_distance_field_, use_signed_environment_field_, all_points);
+  environment_distance_field_points_.swap(field_points);
   visualizeDistanceField(environment_distance_field_);
   //ROS_INFO_STREAM("Adding points took " << (n2-n1).toSec());
 }
@@ -526,9 +748,12 @@ void CollisionProximitySpace::prepareEnvironmentDistanceField(const planning_mod
 void CollisionProximitySpace::prepareSelfDistanceField(const std::vector<std::string>& link_names, 
                                                        const planning_models::KinematicState& state)
 {
-  self_distance_field_->reset();
+  ScopedProfileTimer profile_timer(profiler_, CollisionProximityProfiler::SELF_FIELD);
+  std::map<std::string, std::vector<tf::Vector3> > field_points;
   tf::Transform inv = getInverseWorldTransform(state);
-  std::vector<tf::Vector3> all_points;
+  current_self_local_fields_.clear();
+  current_self_local_field_poses_.clear();
+  current_self_local_field_inverse_poses_.clear();
   for(unsigned int i = 0; i < link_names.size(); i++) {
     if(body_decomposition_map_.find(link_names[i]) == body_decomposition_map_.end()) {
       //there is no collision geometry as far as we can tell
@@ -536,8 +761,18 @@ void CollisionProximitySpace::prepareSelfDistanceField(const std::vector<std::st
     }
     //ROS_INFO_STREAM("Adding link " << link_names[i]);
     const BodyDecomposition* bd = body_decomposition_map_.find(link_names[i])->second;
-    all_points.insert(all_points.end(), bd->getCollisionPoints().begin(), bd->getCollisionPoints().end());
     const planning_models::KinematicState::LinkState* ls = state.getLinkState(link_names[i]);
+    if(use_link_local_self_fields_) {
+      if(local_distance_field_map_.find(link_names[i]) == local_distance_field_map_.end()) {
+        local_distance_field_map_[link_names[i]] = new LocalDistanceField(bd->getRelativeCollisionPoints(), resolution_, max_self_distance_);
+      }
+      tf::Transform pose = inv*ls->getGlobalCollisionBodyTransform();
+      current_self_local_fields_.push_back(local_distance_field_map_[link_names[i]]);
+      current_self_local_field_poses_.push_back(pose);
+      current_self_local_field_inverse_poses_.push_back(pose.inverse());
+    } else {
+      field_points[link_names[i]] = bd->getCollisionPoints();
+    }
     for(unsigned int j = 0; j < ls->getAttachedBodyStateVector().size(); j++) {
       std::string id = makeAttachedObjectId(ls->getName(),ls->getAttachedBodyStateVector()[j]->getName());
       if(attached_object_map_.find(id) == attached_object_map_.end()) {
@@ -545,11 +780,84 @@ void CollisionProximitySpace::prepareSelfDistanceField(const std::vector<std::st
         continue;
       }
       const BodyDecompositionVector* att = attached_object_map_.find(id)->second;
-      const std::vector<tf::Vector3>& att_points = att->getCollisionPoints();
-      all_points.insert(all_points.end(), att_points.begin(), att_points.end());
+      field_points[id] = att->getCollisionPoints();
+    }
+  }
+  //same links in the same poses with the same attached objects
+  if(field_points == self_distance_field_points_) {
+    ROS_DEBUG_STREAM("Self distance field unchanged");
+    return;
+  }
+  std::vector<tf::Vector3> all_points;
+  for(std::map<std::string, std::vector<tf::Vector3> >::iterator it = field_points.begin();
+      it != field_points.end();
+      it++) {
+    all_points.insert(all_points.end(), it->second.begin(), it->second.end());
+  }
+  updateDistanceFieldPoints(self_distance_field_, use_signed_self_field_, all_points);
+  self_distance_field_points_.swap(field_points);
+}
+
+double CollisionProximitySpace::getSelfDistanceGradient(const tf::Vector3& point, tf::Vector3& gradient) const
+{
+  double gx, gy, gz;
+  double dist = self_distance_field_->getDistanceGradient(point.x(), point.y(), point.z(), gx, gy, gz);
+  gradient.setValue(gx, gy, gz);
+  for(unsigned int i = 0; i < current_self_local_fields_.size(); i++) {
+    tf::Vector3 local_point = current_self_local_field_inverse_poses_[i]*point;
+    //can't be closer than the sphere bounding the link
+    if(local_point.distance(current_self_local_fields_[i]->getBoundingCenter())-current_self_local_fields_[i]->getBoundingRadius() >= dist) {
+      continue;
+    }
+    tf::Vector3 local_gradient;
+    double local_dist = current_self_local_fields_[i]->getDistanceGradient(local_point, local_gradient);
+    if(local_dist < dist) {
+      dist = local_dist;
+      gradient = current_self_local_field_poses_[i].getBasis()*local_gradient;
     }
   }
-  self_distance_field_->addPointsToField(all_points);
+  return dist;
+}
+
+bool CollisionProximitySpace::getLocalSelfSphereGradients(const std::vector<CollisionSphere>& sphere_list,
+                                                          GradientInfo& gradient,
+                                                          bool subtract_radii,
+                                                          bool stop_at_first_collision) const
+{
+  bool in_collision = false;
+  for(unsigned int i = 0; i < sphere_list.size(); i++) {
+    tf::Vector3 grad;
+    double dist = getSelfDistanceGradient(sphere_list[i].center_, grad);
+    if(dist < max_self_distance_ && subtract_radii) {
+      dist -= sphere_list[i].radius_;
+      if(dist <= tolerance_) {
+        if(stop_at_first_collision) {
+          return true;
+        }
+        in_collision = true;
+      }
+    }
+    if(dist < gradient.closest_distance) {
+      gradient.closest_distance = dist;
+    }
+    if(i < gradient.distances.size()) {
+      gradient.distances[i] = dist;
+      gradient.gradients[i] = grad;
+    }
+  }
+  return in_collision;
+}
+
+void CollisionProximitySpace::updateDistanceFieldPoints(distance_field::DistanceField<distance_field::PropDistanceFieldVoxel>* distance_field,
+                                                        bool is_signed,
+                                                        const std::vector<tf::Vector3>& points)
+{
+  if(is_signed) {
+    distance_field->reset();
+    distance_field->addPointsToField(points);
+  } else {
+    static_cast<distance_field::PropagationDistanceField*>(distance_field)->updatePointsInField(points, true);
+  }
 }
 
 /*
@@ -620,42 +928,6 @@ double CollisionProximitySpace::getCollisionSphereProximity(const std::vector<Co
   }
   return distance;
 }
-
-bool CollisionProximitySpace::getEnvironmentCollision(const std::vector<std::string>& link_names)
-{
-  updating_objects_lock_.lock();
-  bool any_link_in_coll = false;
-  for(unsigned int i = 0; i < link_names.size(); i++) {
-    if(body_decomposition_map_.find(link_names[i]) == body_decomposition_map_.end()) {
-      ROS_WARN_STREAM("No link " << link_names[i] << " for getEnvironmentCollision");
-      continue;
-    }
-    const BodyDecomposition* bd = body_decomposition_map_.find(link_names[i])->second;
-    bool coll = getCollisionSphereCollision(bd->getCollisionSpheres());
-    if(coll) {
-      ROS_INFO_STREAM("Link " << link_names[i] << " in collision");
-      any_link_in_coll = true;
-    }
-    const planning_models::KinematicModel::LinkModel* lm = monitor_->getKinematicModel()->getLinkModel(link_names[i]);
-    for(unsigned int j = 0; j < lm->getAttachedBodyModels().size(); j++) {
-      std::string id = makeAttachedObjectId(lm->getName(),lm->getAttachedBodyModels()[j]->getName());
-      if(attached_object_map_.find(id) == attached_object_map_.end()) {
-        ROS_WARN_STREAM("Have no attached object body for attached object " << id);
-        continue;
-      }
-      const BodyDecompositionVector* att = attached_object_map_[id];
-      for(unsigned int k = 0; k < att->getSize(); k++) {
-        coll = getCollisionSphereCollision(att->getBodyDecomposition(k)->getCollisionSpheres());
-        if(coll) {
-          ROS_INFO_STREAM("Attached body " << id << " in collision");
-          any_link_in_coll = true;
-        }
-      }
-    }
-  }
-  updating_objects_lock_.unlock();
-  return any_link_in_coll;
-}
 */
 bool CollisionProximitySpace::getGroupLinkAndAttachedBodyNames(const std::string& group_name,
                                                                const planning_models::KinematicState& state,
@@ -794,9 +1066,18 @@ bool CollisionProximitySpace::setupGradientStructures(const std::vector<std::str
 
 bool CollisionProximitySpace::isStateInCollision() const
 {
-  if(isEnvironmentCollision()) return true;
-  if(isSelfCollision()) return true;
-  return isIntraGroupCollision();
+  return isStateInCollision(current_context_);
+}
+
+bool CollisionProximitySpace::isStateInCollision(const GroupStateContext& context) const
+{
+  ScopedProfileTimer profile_timer(profiler_, CollisionProximityProfiler::STATE_COLLISION);
+  std::vector<bool> collisions;
+  //environment and self checks are a lookup per sphere, with whole links
+  //skipped when clear, while intra-group checks are per sphere pair
+  if(getEnvironmentCollisions(context, collisions, true)) return true;
+  if(getSelfCollisions(context, collisions, true)) return true;
+  return getIntraGroupCollisions(context, collisions, true);
 }
 
 bool CollisionProximitySpace::getStateCollisions(bool& in_collision, 
@@ -807,9 +1088,9 @@ bool CollisionProximitySpace::getStateCollisions(bool& in_collision,
   std::vector<bool> env_collisions, intra_collisions, self_collisions;
   env_collisions.resize(collisions.size(), false);
   intra_collisions = self_collisions = env_collisions;
-  bool env_collision = getEnvironmentCollisions(env_collisions, false);
-  bool intra_group_collision = getIntraGroupCollisions(intra_collisions, false);
-  bool self_collision = getSelfCollisions(intra_collisions, false);
+  bool env_collision = getEnvironmentCollisions(current_context_, env_collisions, false);
+  bool intra_group_collision = getIntraGroupCollisions(current_context_, intra_collisions, false);
+  bool self_collision = getSelfCollisions(current_context_, self_collisions, false);
   for(unsigned int i = 0; i < current_link_names_.size()+current_attached_body_names_.size(); i++) {
     collisions[i].environment = env_collisions[i];
     collisions[i].self = self_collisions[i];
@@ -826,15 +1107,42 @@ bool CollisionProximitySpace::getStateCollisions(bool& in_collision,
 bool CollisionProximitySpace::getStateGradients(std::vector<GradientInfo>& gradients,
                                                 bool subtract_radii) const
 {
-  gradients = current_gradients_;
+  return getStateGradients(current_context_, gradients, subtract_radii);
+}
+
+bool CollisionProximitySpace::getStateGradients(const GroupStateContext& context,
+                                                std::vector<GradientInfo>& gradients,
+                                                bool subtract_radii) const
+{
+  if(!gradient_cache_.isEnabled() || context.joint_values.empty()) {
+    return computeStateGradients(context, gradients, subtract_radii);
+  }
+  bool in_collision;
+  if(gradient_cache_.lookup(context.joint_values, subtract_radii, gradients, in_collision)) {
+    profiler_.addCount(CollisionProximityProfiler::GRADIENT_CACHE_HITS, 1);
+    return in_collision;
+  }
+  profiler_.addCount(CollisionProximityProfiler::GRADIENT_CACHE_MISSES, 1);
+  unsigned int generation = gradient_cache_.getGeneration();
+  in_collision = computeStateGradients(context, gradients, subtract_radii);
+  gradient_cache_.insert(generation, context.joint_values, subtract_radii, gradients, in_collision);
+  return in_collision;
+}
+
+bool CollisionProximitySpace::computeStateGradients(const GroupStateContext& context,
+                                                    std::vector<GradientInfo>& gradients,
+                                                    bool subtract_radii) const
+{
+  ScopedProfileTimer profile_timer(profiler_, CollisionProximityProfiler::STATE_GRADIENTS);
+  gradients = context.gradients;
 
   std::vector<GradientInfo> intra_gradients;
   std::vector<GradientInfo> self_gradients;
   std::vector<GradientInfo> env_gradients;
 
-  bool env_coll = getEnvironmentProximityGradients(env_gradients, subtract_radii);
-  bool self_coll = getSelfProximityGradients(self_gradients, subtract_radii);
-  bool intra_coll = getIntraGroupProximityGradients(intra_gradients, subtract_radii);
+  bool env_coll = getEnvironmentProximityGradients(context, env_gradients, subtract_radii);
+  bool self_coll = getSelfProximityGradients(context, self_gradients, subtract_radii);
+  bool intra_coll = getIntraGroupProximityGradients(context, intra_gradients, subtract_radii);
 
   for(unsigned int i = 0; i < gradients.size(); i++) {
     if(i < current_link_names_.size()) {      
@@ -915,6 +1223,11 @@ bool CollisionProximitySpace::getStateGradients(std::vector<GradientInfo>& gradi
         gradients[i].gradients[j] = env_gradients[i].gradients[j];
       }
     }
+
+    if(subtract_radii) {
+      setGradientClearances(env_gradients[i], max_environment_distance_, self_gradients[i], max_self_distance_,
+                            intra_gradients[i], gradients[i]);
+    }
   }
   return (env_coll || intra_coll || self_coll);
 }
@@ -926,39 +1239,33 @@ bool CollisionProximitySpace::isIntraGroupCollision() const
 }
 
 bool CollisionProximitySpace::getIntraGroupCollisions(std::vector<bool>& collisions, bool stop_at_first_collision) const {
+  return getIntraGroupCollisions(current_context_, collisions, stop_at_first_collision);
+}
+
+bool CollisionProximitySpace::getIntraGroupCollisions(const GroupStateContext& context,
+                                                      std::vector<bool>& collisions, 
+                                                      bool stop_at_first_collision) const {
+  ScopedProfileCount pairs_evaluated(profiler_, CollisionProximityProfiler::SPHERE_PAIRS_EVALUATED);
   bool in_collision = false;
   unsigned int num_links = current_link_names_.size();
   unsigned int num_attached = current_attached_body_names_.size();
   unsigned int tot = num_links+num_attached;
+  SphereBlockDistances block_distances;
   for(unsigned int i = 0; i < tot; i++) {
     for(unsigned int j = i; j < tot; j++) {
       if(i == j) continue;
       if(!current_intra_group_collision_links_[i][j]) continue;
-      const std::vector<CollisionSphere>* lcs1;
-      const std::vector<CollisionSphere>* lcs2; 
-      if(i < num_links) {
-        lcs1 = &(current_link_body_decompositions_[i]->getCollisionSpheres());
-      } else {
-        lcs1 = &(current_attached_body_decompositions_[i-num_links]->getCollisionSpheres());
-      }
-      if(j < num_links) {
-        lcs2 = &(current_link_body_decompositions_[j]->getCollisionSpheres());
-      } else {
-        lcs2 = &(current_attached_body_decompositions_[j-num_links]->getCollisionSpheres());
-      }
-      for(unsigned int k = 0; k < lcs1->size(); k++) {
-        for(unsigned int l = 0; l < lcs2->size(); l++) {
-          double dist = (*lcs1)[k].center_.distance((*lcs2)[l].center_);
-          dist += -(*lcs1)[k].radius_-(*lcs2)[l].radius_;
-          if(dist <= tolerance_) {
-            if(stop_at_first_collision) {
-              return true;
-            }
-            collisions[i] = true;
-            collisions[j] = true;
-            in_collision = true;
-          }
+      const std::vector<CollisionSphere>& lcs1 = context.body_spheres[i];
+      const std::vector<CollisionSphere>& lcs2 = context.body_spheres[j];
+      pairs_evaluated.count += lcs1.size()*lcs2.size();
+      if(areSphereBlocksInCollision(lcs1, context.body_sphere_blocks[i], lcs2, context.body_sphere_blocks[j],
+                                    tolerance_, block_distances)) {
+        if(stop_at_first_collision) {
+          return true;
         }
+        collisions[i] = true;
+        collisions[j] = true;
+        in_collision = true;
       }
     }
   }
@@ -967,57 +1274,33 @@ bool CollisionProximitySpace::getIntraGroupCollisions(std::vector<bool>& collisi
 
 bool CollisionProximitySpace::getIntraGroupProximityGradients(std::vector<GradientInfo>& gradients,
                                                               bool subtract_radii) const {
-  gradients = current_gradients_;
+  return getIntraGroupProximityGradients(current_context_, gradients, subtract_radii);
+}
+
+bool CollisionProximitySpace::getIntraGroupProximityGradients(const GroupStateContext& context,
+                                                              std::vector<GradientInfo>& gradients,
+                                                              bool subtract_radii) const {
+  ScopedProfileCount pairs_evaluated(profiler_, CollisionProximityProfiler::SPHERE_PAIRS_EVALUATED);
+  gradients = context.gradients;
   bool in_collision = false;
-  unsigned int count = 0;
   unsigned int num_links = current_link_names_.size();
   unsigned int num_attached = current_attached_body_names_.size();
   unsigned int tot = num_links+num_attached;
-  std::vector<std::string> all_names = current_link_names_;
-  all_names.insert(all_names.end(), current_attached_body_names_.begin(), current_attached_body_names_.end());
+  SphereBlockDistances block_distances;
+  //each pair updates both bodies, so it only needs to be visited once
   for(unsigned int i = 0; i < tot; i++) {
-    for(unsigned int j = 0; j < tot; j++) {
-      if(i == j) continue;
-      if(!current_intra_group_collision_links_[i][j]) {
+    for(unsigned int j = i+1; j < tot; j++) {
+      if(!current_intra_group_collision_links_[i][j] && !current_intra_group_collision_links_[j][i]) {
         continue;
       }
-      const std::vector<CollisionSphere>* lcs1;
-      const std::vector<CollisionSphere>* lcs2; 
-      if(i < num_links) {
-        lcs1 = &(current_link_body_decompositions_[i]->getCollisionSpheres());
-      } else {
-        lcs1 = &(current_attached_body_decompositions_[i-num_links]->getCollisionSpheres());
-      }
-      if(j < num_links) {
-        lcs2 = &(current_link_body_decompositions_[j]->getCollisionSpheres());
-      } else {
-        lcs2 = &(current_attached_body_decompositions_[j-num_links]->getCollisionSpheres());
-      }
-      for(unsigned int k = 0; k < lcs1->size(); k++) {
-        for(unsigned int l = 0; l < lcs2->size(); l++) {
-          double dist = (*lcs1)[k].center_.distance((*lcs2)[l].center_);
-          if(subtract_radii) {
-            dist += -(*lcs1)[k].radius_-(*lcs2)[l].radius_;
-            if(dist <= tolerance_) {
-              in_collision = true;
-            }
-          }
-          count++;
-          if(dist < gradients[i].distances[k]) {
-            gradients[i].distances[k] = dist;
-            gradients[i].gradients[k] = (*lcs1)[k].center_-(*lcs2)[l].center_;
-          }
-          if(dist < gradients[i].closest_distance) {
-            gradients[i].closest_distance = dist;
-          }
-          if(dist < gradients[j].distances[l]) {
-            gradients[j].distances[l] = dist;
-            gradients[j].gradients[l] = (*lcs2)[l].center_-(*lcs1)[k].center_;
-          }
-          if(dist < gradients[j].closest_distance) {
-            gradients[j].closest_distance = dist;
-          }
-        }
+      const std::vector<CollisionSphere>& lcs1 = context.body_spheres[i];
+      const std::vector<CollisionSphere>& lcs2 = context.body_spheres[j];
+      if(lcs1.empty() || lcs2.empty()) continue;
+      pairs_evaluated.count += lcs1.size()*lcs2.size();
+      //the closest pairs are recomputed in double for the reported distances and gradients
+      if(updateSphereBlockGradients(lcs1, context.body_sphere_blocks[i], lcs2, context.body_sphere_blocks[j],
+                                    subtract_radii, tolerance_, gradients[i], gradients[j], block_distances)) {
+        in_collision = true;
       }
     }
   }
@@ -1033,10 +1316,34 @@ bool CollisionProximitySpace::isSelfCollision() const
 bool CollisionProximitySpace::getSelfCollisions(std::vector<bool>& collisions,
                                                 bool stop_at_first_collision) const
 {
+  return getSelfCollisions(current_context_, collisions, stop_at_first_collision);
+}
+
+bool CollisionProximitySpace::getSelfCollisions(const GroupStateContext& context,
+                                                std::vector<bool>& collisions,
+                                                bool stop_at_first_collision) const
+{
+  ScopedProfileCount spheres_evaluated(profiler_, CollisionProximityProfiler::SPHERES_EVALUATED);
+  ScopedProfileCount field_lookups(profiler_, CollisionProximityProfiler::FIELD_LOOKUPS);
   bool in_collision = false;
   for(unsigned int i = 0; i < current_link_names_.size(); i++) {
-    const std::vector<CollisionSphere>& body_spheres = current_link_body_decompositions_[i]->getCollisionSpheres();
-    bool coll = getCollisionSphereCollision(self_distance_field_, body_spheres, tolerance_);
+    const std::vector<CollisionSphere>& body_spheres = context.body_spheres[i];
+    bool coll;
+    if(!use_link_local_self_fields_) {
+      field_lookups.count++;
+      if(isBoundingSphereClear(self_distance_field_, context.link_bounding_sphere_centers[i], 
+                               current_link_body_decompositions_[i]->getBoundingSphereRadius(), tolerance_)) {
+        continue;
+      }
+    }
+    spheres_evaluated.count += body_spheres.size();
+    field_lookups.count += body_spheres.size();
+    if(use_link_local_self_fields_) {
+      GradientInfo gradient;
+      coll = getLocalSelfSphereGradients(body_spheres, gradient, true, true);
+    } else {
+      coll = getCollisionSphereCollision(self_distance_field_, body_spheres, tolerance_);
+    }
     if(coll) {
       if(stop_at_first_collision) {
         return true;
@@ -1046,8 +1353,16 @@ bool CollisionProximitySpace::getSelfCollisions(std::vector<bool>& collisions,
     }
   }
   for(unsigned int i = 0; i < current_attached_body_names_.size(); i++) {
-    const std::vector<CollisionSphere>& body_spheres = current_attached_body_decompositions_[i]->getCollisionSpheres();
-    bool coll = getCollisionSphereCollision(self_distance_field_, body_spheres, tolerance_);
+    const std::vector<CollisionSphere>& body_spheres = context.body_spheres[i+current_link_names_.size()];
+    bool coll;
+    spheres_evaluated.count += body_spheres.size();
+    field_lookups.count += body_spheres.size();
+    if(use_link_local_self_fields_) {
+      GradientInfo gradient;
+      coll = getLocalSelfSphereGradients(body_spheres, gradient, true, true);
+    } else {
+      coll = getCollisionSphereCollision(self_distance_field_, body_spheres, tolerance_);
+    }
     if(coll) {
       if(stop_at_first_collision) {
         return true;
@@ -1061,23 +1376,45 @@ bool CollisionProximitySpace::getSelfCollisions(std::vector<bool>& collisions,
 
 bool CollisionProximitySpace::getSelfProximityGradients(std::vector<GradientInfo>& gradients,
                                                         bool subtract_radii) const {
-  gradients = current_gradients_;
+  return getSelfProximityGradients(current_context_, gradients, subtract_radii);
+}
+
+bool CollisionProximitySpace::getSelfProximityGradients(const GroupStateContext& context,
+                                                        std::vector<GradientInfo>& gradients,
+                                                        bool subtract_radii) const {
+  ScopedProfileCount spheres_evaluated(profiler_, CollisionProximityProfiler::SPHERES_EVALUATED);
+  ScopedProfileCount field_lookups(profiler_, CollisionProximityProfiler::FIELD_LOOKUPS);
+  gradients = context.gradients;
   bool in_collision = false;
   for(unsigned int i = 0; i < current_link_names_.size(); i++) {
     if(!current_self_excludes_[i]) continue;
-    const std::vector<CollisionSphere>& body_spheres = current_link_body_decompositions_[i]->getCollisionSpheres();
+    const std::vector<CollisionSphere>& body_spheres = context.body_spheres[i];
+    spheres_evaluated.count += body_spheres.size();
+    field_lookups.count += body_spheres.size();
     if(gradients[i].distances.size() != body_spheres.size()) {
       ROS_INFO_STREAM("Wrong size for closest distances for link " << current_link_names_[i]);
     }
-    bool coll = getCollisionSphereGradients(self_distance_field_, body_spheres, gradients[i], tolerance_, subtract_radii, max_self_distance_, false);
+    bool coll;
+    if(use_link_local_self_fields_) {
+      coll = getLocalSelfSphereGradients(body_spheres, gradients[i], subtract_radii, false);
+    } else {
+      coll = getCollisionSphereGradients(self_distance_field_, body_spheres, gradients[i], tolerance_, subtract_radii, max_self_distance_, false);
+    }
     if(coll) {
       in_collision = true;
     }
   }
   for(unsigned int i = 0; i < current_attached_body_names_.size(); i++) {
-    const std::vector<CollisionSphere>& body_spheres = current_attached_body_decompositions_[i]->getCollisionSpheres();
-    bool coll = getCollisionSphereGradients(self_distance_field_, body_spheres, gradients[i+current_link_names_.size()],
-                                            tolerance_, subtract_radii, max_self_distance_, false);
+    const std::vector<CollisionSphere>& body_spheres = context.body_spheres[i+current_link_names_.size()];
+    bool coll;
+    spheres_evaluated.count += body_spheres.size();
+    field_lookups.count += body_spheres.size();
+    if(use_link_local_self_fields_) {
+      coll = getLocalSelfSphereGradients(body_spheres, gradients[i+current_link_names_.size()], subtract_radii, false);
+    } else {
+      coll = getCollisionSphereGradients(self_distance_field_, body_spheres, gradients[i+current_link_names_.size()],
+                                         tolerance_, subtract_radii, max_self_distance_, false);
+    }
     if(coll) {
       in_collision = true;
     }
@@ -1094,10 +1431,25 @@ bool CollisionProximitySpace::isEnvironmentCollision() const
 bool CollisionProximitySpace::getEnvironmentCollisions(std::vector<bool>& collisions,
                                                        bool stop_at_first_collision) const
 {
+  return getEnvironmentCollisions(current_context_, collisions, stop_at_first_collision);
+}
+
+bool CollisionProximitySpace::getEnvironmentCollisions(const GroupStateContext& context,
+                                                       std::vector<bool>& collisions,
+                                                       bool stop_at_first_collision) const
+{
+  ScopedProfileCount spheres_evaluated(profiler_, CollisionProximityProfiler::SPHERES_EVALUATED);
+  ScopedProfileCount field_lookups(profiler_, CollisionProximityProfiler::FIELD_LOOKUPS);
   bool in_collision = false;
   for(unsigned int i = 0; i < current_link_names_.size(); i++) {
-    const std::vector<CollisionSphere>& body_spheres = current_link_body_decompositions_[i]->getCollisionSpheres();
-    bool coll = getCollisionSphereCollision(environment_distance_field_, body_spheres, tolerance_);
+    field_lookups.count++;
+    if(isBoundingSphereClear(environment_distance_field_, context.link_bounding_sphere_centers[i], 
+                             current_link_body_decompositions_[i]->getBoundingSphereRadius(), tolerance_)) {
+      continue;
+    }
+    spheres_evaluated.count += context.body_spheres[i].size();
+    field_lookups.count += context.body_spheres[i].size();
+    bool coll = getCollisionSphereCollision(environment_distance_field_, context.body_spheres[i], tolerance_);
     if(coll) {
       if(stop_at_first_collision) {
         return true;
@@ -1107,7 +1459,9 @@ bool CollisionProximitySpace::getEnvironmentCollisions(std::vector<bool>& collis
     }
   }
   for(unsigned int i = 0; i < current_attached_body_names_.size(); i++) {
-    const std::vector<CollisionSphere>& body_spheres = current_attached_body_decompositions_[i]->getCollisionSpheres();
+    const std::vector<CollisionSphere>& body_spheres = context.body_spheres[i+current_link_names_.size()];
+    spheres_evaluated.count += body_spheres.size();
+    field_lookups.count += body_spheres.size();
     bool coll = getCollisionSphereCollision(environment_distance_field_, body_spheres, tolerance_);
     if(coll) {
       if(stop_at_first_collision) {
@@ -1122,10 +1476,20 @@ bool CollisionProximitySpace::getEnvironmentCollisions(std::vector<bool>& collis
 
 bool CollisionProximitySpace::getEnvironmentProximityGradients(std::vector<GradientInfo>& gradients,
                                                                bool subtract_radii) const {
-  gradients = current_gradients_;
+  return getEnvironmentProximityGradients(current_context_, gradients, subtract_radii);
+}
+
+bool CollisionProximitySpace::getEnvironmentProximityGradients(const GroupStateContext& context,
+                                                               std::vector<GradientInfo>& gradients,
+                                                               bool subtract_radii) const {
+  ScopedProfileCount spheres_evaluated(profiler_, CollisionProximityProfiler::SPHERES_EVALUATED);
+  ScopedProfileCount field_lookups(profiler_, CollisionProximityProfiler::FIELD_LOOKUPS);
+  gradients = context.gradients;
   bool in_collision = false;
   for(unsigned int i = 0; i < current_link_names_.size(); i++) {
-    const std::vector<CollisionSphere>& body_spheres = current_link_body_decompositions_[i]->getCollisionSpheres();
+    const std::vector<CollisionSphere>& body_spheres = context.body_spheres[i];
+    spheres_evaluated.count += body_spheres.size();
+    field_lookups.count += body_spheres.size();
     if(gradients[i].distances.size() != body_spheres.size()) {
       ROS_INFO_STREAM("Wrong size for closest distances for link " << current_link_names_[i]);
     }
@@ -1135,7 +1499,9 @@ bool CollisionProximitySpace::getEnvironmentProximityGradients(std::vector<Gradi
     }
   }
   for(unsigned int i = 0; i < current_attached_body_names_.size(); i++) {
-    const std::vector<CollisionSphere>& body_spheres = current_attached_body_decompositions_[i]->getCollisionSpheres();
+    const std::vector<CollisionSphere>& body_spheres = context.body_spheres[i+current_link_names_.size()];
+    spheres_evaluated.count += body_spheres.size();
+    field_lookups.count += body_spheres.size();
     bool coll = getCollisionSphereGradients(environment_distance_field_, body_spheres, gradients[i+current_link_names_.size()], tolerance_, subtract_radii, max_environment_distance_, false);
     if(coll) {
       in_collision = true;
@@ -1152,16 +1518,15 @@ void CollisionProximitySpace::getProximityGradientMarkers(const std::vector<std:
 {
   for(unsigned int i = 0; i < gradients.size(); i++) {
     
-    const std::vector<CollisionSphere>* lcs;
     std::string name;
     if(i < link_names.size()) {
       name = link_names[i];
-      lcs = &(body_decomposition_map_.find(name)->second->getCollisionSpheres());
     } else {
       name = attached_body_names[i-link_names.size()];
-      lcs = &(attached_object_map_.find(name)->second->getCollisionSpheres());
     }
-    for(unsigned int j = 0; j < gradients[i].distances.size(); j++) {
+    //the decompositions themselves aren't posed by the queries, so the
+    //sphere locations recorded with the gradients are the ones to draw
+    for(unsigned int j = 0; j < gradients[i].distances.size() && j < gradients[i].sphere_locations.size(); j++) {
       visualization_msgs::Marker arrow_mark;
       arrow_mark.header.frame_id = collision_models_interface_->getRobotFrameId();
       arrow_mark.header.stamp = ros::Time::now();
@@ -1186,9 +1551,9 @@ void CollisionProximitySpace::getProximityGradientMarkers(const std::vector<std:
         ROS_DEBUG_STREAM("Negative dist for " << name << " " << arrow_mark.id);
       }
       arrow_mark.points.resize(2);
-      arrow_mark.points[1].x = (*lcs)[j].center_.x();
-      arrow_mark.points[1].y = (*lcs)[j].center_.y();
-      arrow_mark.points[1].z = (*lcs)[j].center_.z();
+      arrow_mark.points[1].x = gradients[i].sphere_locations[j].x();
+      arrow_mark.points[1].y = gradients[i].sphere_locations[j].y();
+      arrow_mark.points[1].z = gradients[i].sphere_locations[j].z();
       arrow_mark.points[0] = arrow_mark.points[1];
       arrow_mark.points[0].x -= xscale*gradients[i].distances[j];
       arrow_mark.points[0].y -= yscale*gradients[i].distances[j];
@@ -1204,11 +1569,66 @@ void CollisionProximitySpace::getProximityGradientMarkers(const std::vector<std:
   }
 }
 
+struct CollisionProximitySpace::TrajectoryEvaluation
+{
+  TrajectoryEvaluation(unsigned int num_points) :
+    evaluated(num_points, false),
+    in_collision(num_points, false),
+    distances(num_points),
+    gradients(num_points),
+    stop_index(num_points)
+  {
+  }
+
+  // records the result for a point, and once there is a collision between two 
+  // free points the trajectory can't be safe, so later points needn't be evaluated
+  void addResult(unsigned int index, bool point_in_collision)
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    if(point_in_collision) {
+      collision_points.insert(index);
+    } else {
+      free_points.insert(index);
+    }
+    if(free_points.empty()) {
+      return;
+    }
+    std::set<unsigned int>::iterator coll_it = collision_points.upper_bound(*free_points.begin());
+    if(coll_it == collision_points.end()) {
+      return;
+    }
+    std::set<unsigned int>::iterator free_it = free_points.upper_bound(*coll_it);
+    if(free_it != free_points.end() && *free_it < stop_index) {
+      stop_index = *free_it;
+    }
+  }
+
+  unsigned int getStopIndex()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    return stop_index;
+  }
+
+  //each point is only written by one worker, and only read once the workers are joined
+  std::vector<char> evaluated;
+  std::vector<char> in_collision;
+  std::vector<std::vector<double> > distances;
+  std::vector<std::vector<GradientInfo> > gradients;
+
+  boost::mutex mutex;
+  std::set<unsigned int> free_points;
+  std::set<unsigned int> collision_points;
+  unsigned int stop_index;
+};
+
 CollisionProximitySpace::TrajectorySafety CollisionProximitySpace::isTrajectorySafe(const trajectory_msgs::JointTrajectory& trajectory,
                                                                                     const arm_navigation_msgs::Constraints& goal_constraints,
                                                                                     const arm_navigation_msgs::Constraints& path_constraints,
                                                                                     const std::string& groupName)
 {
+  // this moves the shared planning scene state around, so concurrent callers take turns
+  boost::recursive_mutex::scoped_lock lock(group_queries_lock_);
+  ScopedProfileTimer profile_timer(profiler_, CollisionProximityProfiler::TRAJECTORY_SAFETY);
   ROS_DEBUG_NAMED("safety", "Calling isTrajectorySafe");
 
   collision_models_interface_->resetToStartState(*collision_models_interface_->getPlanningSceneState());
@@ -1237,9 +1657,19 @@ CollisionProximitySpace::TrajectorySafety CollisionProximitySpace::isTrajectoryS
   //   }
   // }
   
+  TrajectoryEvaluation evaluation(trajectory.points.size());
+  bool mesh_to_mesh_valid;
+  // Without constraints, points well clear of everything according to the distance fields
+  // can't have mesh to mesh collisions, so only the rest need the mesh check
+  if(trajectory_safety_margin_ > 0.0 && areConstraintsEmpty(goal_constraints) && areConstraintsEmpty(path_constraints)) {
+    mesh_to_mesh_valid = isTrajectoryValidOutsideMargin(trajectory, groupName, evaluation, error_code, error_codes);
+  } else {
+    mesh_to_mesh_valid = collision_models_interface_->isJointTrajectoryValid(*(collision_models_interface_->getPlanningSceneState()),
+                                                                             trajectory, goal_constraints, path_constraints, error_code, error_codes, false);
+  }
+
   // If the trajectory is already valid and has no mesh to mesh collisions, we know it's safe.
-  if(collision_models_interface_->isJointTrajectoryValid(*(collision_models_interface_->getPlanningSceneState()),
-                                                         trajectory, goal_constraints, path_constraints, error_code, error_codes, false))
+  if(mesh_to_mesh_valid)
   {
     ROS_INFO_STREAM("Mesh to mesh valid");
     return MeshToMeshSafe;
@@ -1250,6 +1680,17 @@ CollisionProximitySpace::TrajectorySafety CollisionProximitySpace::isTrajectoryS
   {
     ROS_DEBUG_STREAM("Mesh to mesh invalid with " << error_code.val);
 
+    // Points are evaluated up front by workers with their own state copies if configured,
+    // and any the workers skipped are evaluated below as they're needed
+    evaluateTrajectoryInParallel(trajectory, groupName, evaluation);
+    GroupStateContext context;
+
+    bool check_swept_spheres = use_swept_sphere_checking_;
+    if(check_swept_spheres && !canBoundSweptSpheres(stateGroup)) {
+      ROS_WARN_STREAM("Group " << groupName << " has joints that aren't single revolute or prismatic joints, not checking swept spheres");
+      check_swept_spheres = false;
+    }
+
     std::vector<double> lastDistances;
     TrajectoryPointType type = None;
     // For each trajectory point, get gradients and assert that the collision cost of start points
@@ -1262,27 +1703,23 @@ CollisionProximitySpace::TrajectorySafety CollisionProximitySpace::isTrajectoryS
     //+--------------------------------------------------------------------------------------------------------------+
     for(size_t i = 0; i < trajectory.points.size(); i++)
     {
-      std::vector<GradientInfo> gradients;
-      std::vector<double> distances;
       const trajectory_msgs::JointTrajectoryPoint& trajectoryPoint =  trajectory.points[i];
-      stateGroup->setKinematicState(trajectoryPoint.positions);
-      setCurrentGroupState(*(collision_models_interface_->getPlanningSceneState()));
-
-      getStateGradients(gradients, true);
-      bool in_collision = false;
-      for(size_t j = 0; j < gradients.size(); j++)
+      if(!evaluation.evaluated[i]) {
+        evaluation.in_collision[i] = evaluateTrajectoryPoint(*collision_models_interface_->getPlanningSceneState(), stateGroup, context,
+                                                             trajectoryPoint.positions, evaluation.gradients[i], evaluation.distances[i]);
+        evaluation.evaluated[i] = true;
+      }
+      bool in_collision = evaluation.in_collision[i];
+      const std::vector<double>& distances = evaluation.distances[i];
+
+      // Samples on both sides are clear, but the spheres may still pass through something in between
+      if(check_swept_spheres && i != 0 && !in_collision && !evaluation.in_collision[i-1] &&
+         !isSweptSegmentSafe(*collision_models_interface_->getPlanningSceneState(), stateGroup, context,
+                             trajectory.points[i-1].positions, evaluation.gradients[i-1], 
+                             trajectoryPoint.positions, evaluation.gradients[i], 0))
       {
-        GradientInfo& gradient = gradients[j];
-        in_collision = in_collision || gradient.collision;
-
-        for(size_t k = 0; k < gradient.distances.size(); k++)
-        {
-          distances.push_back(gradient.distances[k]);
-          in_collision = in_collision || gradient.distances[k] < tolerance_;
-          //if(gradient.distances[k] < tolerance_) {
-          //  ROS_INFO_STREAM("Point i " << i << " sphere " << k << " distance " << gradient.distances[k] << " less than tolerance " << tolerance_);
-          //}
-        }
+        ROS_DEBUG_NAMED("safety","Swept spheres between points %lu and %lu are in collision", (long unsigned int)i-1, (long unsigned int)i);
+        return MiddleUnsafe;
       }
 
       // If the first point is in collision, we're in the start collision phase
@@ -1391,6 +1828,281 @@ CollisionProximitySpace::TrajectorySafety CollisionProximitySpace::isTrajectoryS
 
 }
 
+bool CollisionProximitySpace::isTrajectoryValidOutsideMargin(const trajectory_msgs::JointTrajectory& trajectory,
+                                                             const std::string& group_name,
+                                                             TrajectoryEvaluation& evaluation,
+                                                             arm_navigation_msgs::ArmNavigationErrorCodes& error_code,
+                                                             std::vector<arm_navigation_msgs::ArmNavigationErrorCodes>& error_codes)
+{
+  evaluateTrajectoryInParallel(trajectory, group_name, evaluation);
+  planning_models::KinematicState* state = collision_models_interface_->getPlanningSceneState();
+  planning_models::KinematicState::JointStateGroup* state_group = state->getJointStateGroup(group_name);
+  GroupStateContext context;
+  trajectory_msgs::JointTrajectory near_trajectory;
+  near_trajectory.header = trajectory.header;
+  near_trajectory.joint_names = trajectory.joint_names;
+  std::vector<unsigned int> near_indices;
+  //points that are clear by the margin are reported as successes
+  error_codes.resize(trajectory.points.size());
+  for(unsigned int i = 0; i < trajectory.points.size(); i++) {
+    error_codes[i].val = error_codes[i].SUCCESS;
+  }
+  for(unsigned int i = 0; i < trajectory.points.size(); i++) {
+    if(!evaluation.evaluated[i]) {
+      evaluation.in_collision[i] = evaluateTrajectoryPoint(*state, state_group, context, trajectory.points[i].positions,
+                                                           evaluation.gradients[i], evaluation.distances[i]);
+      evaluation.evaluated[i] = true;
+    }
+    if(evaluation.in_collision[i] || !areSpheresOutsideMargin(evaluation.gradients[i], trajectory_safety_margin_)) {
+      near_trajectory.points.push_back(trajectory.points[i]);
+      near_indices.push_back(i);
+      continue;
+    }
+    //the mesh check would have caught these too
+    state_group->setKinematicState(trajectory.points[i].positions);
+    if(!state->areJointsWithinBounds(trajectory.joint_names)) {
+      ROS_DEBUG_STREAM("Point " << i << " is outside the joint bounds");
+      error_code.val = error_code.JOINT_LIMITS_VIOLATED;
+      error_codes[i] = error_code;
+      return false;
+    }
+  }
+  ROS_DEBUG_STREAM(near_trajectory.points.size() << " of " << trajectory.points.size() 
+                   << " points are within the safety margin");
+  collision_models_interface_->resetToStartState(*state);
+  if(near_trajectory.points.empty()) {
+    return true;
+  }
+  arm_navigation_msgs::Constraints empty_constraints;
+  std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> near_error_codes;
+  bool valid = collision_models_interface_->isJointTrajectoryValid(*state, near_trajectory, empty_constraints, empty_constraints,
+                                                                   error_code, near_error_codes, false);
+  //the mesh check only saw the near points, so its codes go back to their place in the full trajectory
+  for(unsigned int i = 0; i < near_indices.size(); i++) {
+    if(i < near_error_codes.size()) {
+      error_codes[near_indices[i]] = near_error_codes[i];
+    } else {
+      error_codes[near_indices[i]] = arm_navigation_msgs::ArmNavigationErrorCodes();
+    }
+  }
+  return valid;
+}
+
+void CollisionProximitySpace::evaluateTrajectoryInParallel(const trajectory_msgs::JointTrajectory& trajectory,
+                                                           const std::string& group_name,
+                                                           TrajectoryEvaluation& evaluation) const
+{
+  if(trajectory_safety_threads_ <= 1 || trajectory.points.size() <= 1) {
+    return;
+  }
+  unsigned int num_threads = std::min(trajectory_safety_threads_, (unsigned int)trajectory.points.size());
+  boost::thread_group workers;
+  for(unsigned int i = 0; i < num_threads; i++) {
+    workers.create_thread(boost::bind(&CollisionProximitySpace::evaluateTrajectoryPoints, this,
+                                      collision_models_interface_->getPlanningSceneState(), group_name,
+                                      &trajectory, i, num_threads, &evaluation));
+  }
+  workers.join_all();
+}
+
+void CollisionProximitySpace::evaluateTrajectoryPoints(const planning_models::KinematicState* start_state,
+                                                       const std::string& group_name,
+                                                       const trajectory_msgs::JointTrajectory* trajectory,
+                                                       unsigned int thread_index,
+                                                       unsigned int num_threads,
+                                                       TrajectoryEvaluation* evaluation) const
+{
+  planning_models::KinematicState state(*start_state);
+  planning_models::KinematicState::JointStateGroup* state_group = state.getJointStateGroup(group_name);
+  GroupStateContext context;
+  for(unsigned int i = thread_index; i < trajectory->points.size(); i += num_threads) {
+    //points are taken in order, so everything before the stop index still gets evaluated
+    if(i > evaluation->getStopIndex()) {
+      break;
+    }
+    if(evaluation->evaluated[i]) {
+      continue;
+    }
+    bool in_collision = evaluateTrajectoryPoint(state, state_group, context, trajectory->points[i].positions,
+                                                evaluation->gradients[i], evaluation->distances[i]);
+    evaluation->in_collision[i] = in_collision;
+    evaluation->evaluated[i] = true;
+    evaluation->addResult(i, in_collision);
+  }
+}
+
+bool CollisionProximitySpace::evaluateTrajectoryPoint(planning_models::KinematicState& state,
+                                                      planning_models::KinematicState::JointStateGroup* state_group,
+                                                      GroupStateContext& context,
+                                                      const std::vector<double>& positions,
+                                                      std::vector<GradientInfo>& gradients,
+                                                      std::vector<double>& distances) const
+{
+  state_group->setKinematicState(positions);
+  setGroupStateContext(state, context);
+
+  getStateGradients(context, gradients, true);
+  bool in_collision = false;
+  for(size_t j = 0; j < gradients.size(); j++)
+  {
+    GradientInfo& gradient = gradients[j];
+    in_collision = in_collision || gradient.collision;
+
+    for(size_t k = 0; k < gradient.distances.size(); k++)
+    {
+      distances.push_back(gradient.distances[k]);
+      in_collision = in_collision || gradient.distances[k] < tolerance_;
+      //if(gradient.distances[k] < tolerance_) {
+      //  ROS_INFO_STREAM("Point i " << i << " sphere " << k << " distance " << gradient.distances[k] << " less than tolerance " << tolerance_);
+      //}
+    }
+  }
+  return in_collision;
+}
+
+bool CollisionProximitySpace::canBoundSweptSpheres(const planning_models::KinematicState::JointStateGroup* state_group) const
+{
+  const std::vector<planning_models::KinematicState::JointState*>& joint_states = state_group->getJointStateVector();
+  for(unsigned int i = 0; i < joint_states.size(); i++) {
+    const planning_models::KinematicModel::JointModel* jm = joint_states[i]->getJointModel();
+    if(dynamic_cast<const planning_models::KinematicModel::RevoluteJointModel*>(jm) == NULL &&
+       dynamic_cast<const planning_models::KinematicModel::PrismaticJointModel*>(jm) == NULL) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void CollisionProximitySpace::getSweptSphereTravelBounds(planning_models::KinematicState& state,
+                                                         planning_models::KinematicState::JointStateGroup* state_group,
+                                                         const std::vector<double>& positions_1,
+                                                         const std::vector<GradientInfo>& gradients_1,
+                                                         const std::vector<double>& positions_2,
+                                                         const std::vector<GradientInfo>& gradients_2,
+                                                         std::vector<std::vector<double> >& travel_bounds) const
+{
+  //joint changes along the segment, going the short way round for continuous joints
+  const std::vector<planning_models::KinematicState::JointState*>& joint_states = state_group->getJointStateVector();
+  std::map<const planning_models::KinematicModel::JointModel*, double> joint_changes;
+  std::set<const planning_models::KinematicModel::JointModel*> prismatic_joints;
+  for(unsigned int i = 0; i < joint_states.size() && i < positions_1.size(); i++) {
+    const planning_models::KinematicModel::JointModel* jm = joint_states[i]->getJointModel();
+    const planning_models::KinematicModel::RevoluteJointModel* revolute = dynamic_cast<const planning_models::KinematicModel::RevoluteJointModel*>(jm);
+    if(revolute != NULL && revolute->continuous_) {
+      joint_changes[jm] = fabs(angles::shortest_angular_distance(positions_1[i], positions_2[i]));
+    } else {
+      joint_changes[jm] = fabs(positions_2[i]-positions_1[i]);
+    }
+    if(revolute == NULL) {
+      prismatic_joints.insert(jm);
+    }
+  }
+
+  //link origins at both ends, in the frame the spheres are posed in
+  unsigned int num_links = state.getLinkStateVector().size();
+  std::vector<tf::Vector3> origins_1(num_links), origins_2(num_links);
+  state_group->setKinematicState(positions_1);
+  tf::Transform inv = getInverseWorldTransform(state);
+  for(unsigned int i = 0; i < num_links; i++) {
+    origins_1[i] = inv*state.getLinkStateVector()[i]->getGlobalLinkTransform().getOrigin();
+  }
+  state_group->setKinematicState(positions_2);
+  inv = getInverseWorldTransform(state);
+  for(unsigned int i = 0; i < num_links; i++) {
+    origins_2[i] = inv*state.getLinkStateVector()[i]->getGlobalLinkTransform().getOrigin();
+  }
+  std::map<std::string, unsigned int> link_indices;
+  for(unsigned int i = 0; i < num_links; i++) {
+    link_indices[state.getLinkStateVector()[i]->getName()] = i;
+  }
+
+  travel_bounds.resize(gradients_1.size());
+  for(unsigned int i = 0; i < gradients_1.size(); i++) {
+    unsigned int link_index;
+    if(i < current_link_indices_.size()) {
+      link_index = current_link_indices_[i];
+    } else {
+      link_index = current_attached_body_indices_[i-current_link_indices_.size()];
+    }
+    //A sums what the joints contribute up to the link origin, and B is how much
+    //each unit of distance from the link origin adds on top of that.  Revolute
+    //axes pass through the origins of their child links, and each distance along
+    //the chain is fixed or, across a prismatic joint, convex in the joint value,
+    //so taking the larger end for each keeps the bound along the whole segment
+    double A = 0.0;
+    double B = 0.0;
+    double chain_length = 0.0;
+    const planning_models::KinematicModel::LinkModel* lm = state.getLinkStateVector()[link_index]->getLinkModel();
+    while(lm != NULL && lm->getParentJointModel() != NULL) {
+      const planning_models::KinematicModel::JointModel* jm = lm->getParentJointModel();
+      std::map<const planning_models::KinematicModel::JointModel*, double>::const_iterator it = joint_changes.find(jm);
+      if(it != joint_changes.end()) {
+        if(prismatic_joints.find(jm) != prismatic_joints.end()) {
+          A += it->second;
+        } else {
+          A += it->second*chain_length;
+          B += it->second;
+        }
+      }
+      const planning_models::KinematicModel::LinkModel* parent = jm->getParentLinkModel();
+      if(parent != NULL) {
+        unsigned int child_index = link_indices[lm->getName()];
+        unsigned int parent_index = link_indices[parent->getName()];
+        chain_length += std::max(origins_1[child_index].distance(origins_1[parent_index]),
+                                 origins_2[child_index].distance(origins_2[parent_index]));
+      }
+      lm = parent;
+    }
+    travel_bounds[i].resize(gradients_1[i].sphere_locations.size());
+    for(unsigned int j = 0; j < gradients_1[i].sphere_locations.size() && j < gradients_2[i].sphere_locations.size(); j++) {
+      double reach = std::max(gradients_1[i].sphere_locations[j].distance(origins_1[link_index]),
+                              gradients_2[i].sphere_locations[j].distance(origins_2[link_index]));
+      travel_bounds[i][j] = A+B*reach;
+    }
+  }
+}
+
+bool CollisionProximitySpace::isSweptSegmentSafe(planning_models::KinematicState& state,
+                                                 planning_models::KinematicState::JointStateGroup* state_group,
+                                                 GroupStateContext& context,
+                                                 const std::vector<double>& positions_1,
+                                                 const std::vector<GradientInfo>& gradients_1,
+                                                 const std::vector<double>& positions_2,
+                                                 const std::vector<GradientInfo>& gradients_2,
+                                                 unsigned int depth) const
+{
+  std::vector<std::vector<double> > travel_bounds;
+  getSweptSphereTravelBounds(state, state_group, positions_1, gradients_1, positions_2, gradients_2, travel_bounds);
+
+  if(areSweptSpheresCovered(gradients_1, gradients_2, travel_bounds, tolerance_)) {
+    return true;
+  }
+  if(depth >= swept_sphere_max_depth_) {
+    ROS_DEBUG_STREAM("Swept sphere check reached maximum depth " << depth);
+    return false;
+  }
+  std::vector<double> mid_positions(positions_1.size());
+  const std::vector<planning_models::KinematicState::JointState*>& joint_states = state_group->getJointStateVector();
+  for(unsigned int i = 0; i < positions_1.size(); i++) {
+    const planning_models::KinematicModel::RevoluteJointModel* revolute = NULL;
+    if(i < joint_states.size()) {
+      revolute = dynamic_cast<const planning_models::KinematicModel::RevoluteJointModel*>(joint_states[i]->getJointModel());
+    }
+    if(revolute != NULL && revolute->continuous_) {
+      mid_positions[i] = positions_1[i]+angles::shortest_angular_distance(positions_1[i], positions_2[i])/2.0;
+    } else {
+      mid_positions[i] = (positions_1[i]+positions_2[i])/2.0;
+    }
+  }
+  std::vector<GradientInfo> mid_gradients;
+  std::vector<double> mid_distances;
+  if(evaluateTrajectoryPoint(state, state_group, context, mid_positions, mid_gradients, mid_distances)) {
+    return false;
+  }
+  return (isSweptSegmentSafe(state, state_group, context, positions_1, gradients_1, mid_positions, mid_gradients, depth+1) &&
+          isSweptSegmentSafe(state, state_group, context, mid_positions, mid_gradients, positions_2, gradients_2, depth+1));
+}
+
 ////////////
 // Visualization functions
 ///////////
@@ -35,6 +35,27 @@
 /** \author E. Gil Jones */
 
 #include <collision_proximity/collision_proximity_types.h>
+#include <boost/thread/mutex.hpp>
+#include <map>
+
+namespace
+{
+
+//greedy decompositions are expensive, so they are shared between all
+//bodies built from the same shape with the same parameters
+boost::mutex greedy_sphere_cache_lock;
+std::map<std::string, std::vector<collision_proximity::CollisionSphere> > greedy_sphere_cache;
+
+void hashBytes(unsigned long long& hash, const void* data, size_t size)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for(size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+}
+
+}
 
 std::vector<collision_proximity::CollisionSphere> collision_proximity::determineCollisionSpheres(const bodies::Body* body, tf::Transform& relativeTransform)
 {
@@ -55,20 +76,255 @@ std::vector<collision_proximity::CollisionSphere> collision_proximity::determine
   return css; 
 }
 
+std::vector<collision_proximity::CollisionSphere> collision_proximity::determineCollisionSpheresGreedy(const bodies::Body* body,
+                                                                                                  const std::vector<tf::Vector3>& interior_points,
+                                                                                                  double resolution,
+                                                                                                  double max_error,
+                                                                                                  unsigned int max_spheres)
+{
+  std::vector<collision_proximity::CollisionSphere> css;
+  if(interior_points.empty() || max_spheres == 0) {
+    return css;
+  }
+
+  //interior points with a neighbor outside the body approximate the surface
+  std::vector<tf::Vector3> boundary_points;
+  const tf::Vector3 offsets[6] = {tf::Vector3(resolution,0.0,0.0), tf::Vector3(-resolution,0.0,0.0),
+                                  tf::Vector3(0.0,resolution,0.0), tf::Vector3(0.0,-resolution,0.0),
+                                  tf::Vector3(0.0,0.0,resolution), tf::Vector3(0.0,0.0,-resolution)};
+  for(unsigned int i = 0; i < interior_points.size(); i++) {
+    for(unsigned int j = 0; j < 6; j++) {
+      if(!body->containsPoint(body->getPose()*(interior_points[i]+offsets[j]))) {
+        boundary_points.push_back(interior_points[i]);
+        break;
+      }
+    }
+  }
+
+  //candidate centers are a subsample of the interior, each with the largest
+  //radius that stays within max_error of the surface
+  unsigned int stride = interior_points.size()/2000+1;
+  std::vector<tf::Vector3> candidate_centers;
+  std::vector<double> candidate_radii;
+  for(unsigned int i = 0; i < interior_points.size(); i += stride) {
+    double min_dist = DBL_MAX;
+    for(unsigned int j = 0; j < boundary_points.size(); j++) {
+      double dist = interior_points[i].distance2(boundary_points[j]);
+      if(dist < min_dist) {
+        min_dist = dist;
+      }
+    }
+    candidate_centers.push_back(interior_points[i]);
+    candidate_radii.push_back((min_dist == DBL_MAX ? 0.0 : sqrt(min_dist)) + max_error);
+  }
+
+  std::vector<bool> covered(interior_points.size(), false);
+  unsigned int num_uncovered = interior_points.size();
+  while(num_uncovered > 0 && css.size() < max_spheres) {
+    unsigned int best_count = 0;
+    unsigned int best_index = 0;
+    for(unsigned int i = 0; i < candidate_centers.size(); i++) {
+      double rad2 = candidate_radii[i]*candidate_radii[i];
+      unsigned int count = 0;
+      for(unsigned int j = 0; j < interior_points.size(); j++) {
+        if(!covered[j] && candidate_centers[i].distance2(interior_points[j]) <= rad2) {
+          count++;
+        }
+      }
+      if(count > best_count) {
+        best_count = count;
+        best_index = i;
+      }
+    }
+    if(best_count == 0) {
+      break;
+    }
+    double rad2 = candidate_radii[best_index]*candidate_radii[best_index];
+    for(unsigned int j = 0; j < interior_points.size(); j++) {
+      if(!covered[j] && candidate_centers[best_index].distance2(interior_points[j]) <= rad2) {
+        covered[j] = true;
+        num_uncovered--;
+      }
+    }
+    css.push_back(collision_proximity::CollisionSphere(candidate_centers[best_index], candidate_radii[best_index]));
+  }
+
+  //out of budget, so grow the closest sphere to keep the cover conservative.
+  //Points may already be inside a sphere grown for an earlier point
+  if(num_uncovered > 0 && !css.empty()) {
+    ROS_DEBUG_STREAM("Sphere budget of " << max_spheres << " exhausted with " << num_uncovered << " points uncovered, growing spheres");
+    for(unsigned int j = 0; j < interior_points.size(); j++) {
+      if(covered[j]) continue;
+      unsigned int closest = 0;
+      double min_excess = DBL_MAX;
+      for(unsigned int i = 0; i < css.size(); i++) {
+        double excess = css[i].relative_vec_.distance(interior_points[j])-css[i].radius_;
+        if(excess < min_excess) {
+          min_excess = excess;
+          closest = i;
+        }
+      }
+      if(min_excess > 0.0) {
+        css[closest].radius_ += min_excess;
+      }
+    }
+  }
+  return css;
+}
+
+unsigned long long collision_proximity::computeShapeHash(const shapes::Shape* shape)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  hashBytes(hash, &shape->type, sizeof(shape->type));
+  switch(shape->type) {
+  case shapes::SPHERE:
+    hashBytes(hash, &static_cast<const shapes::Sphere*>(shape)->radius, sizeof(double));
+    break;
+  case shapes::BOX:
+    hashBytes(hash, static_cast<const shapes::Box*>(shape)->size, 3*sizeof(double));
+    break;
+  case shapes::CYLINDER:
+    hashBytes(hash, &static_cast<const shapes::Cylinder*>(shape)->radius, sizeof(double));
+    hashBytes(hash, &static_cast<const shapes::Cylinder*>(shape)->length, sizeof(double));
+    break;
+  case shapes::MESH:
+    {
+      const shapes::Mesh* mesh = static_cast<const shapes::Mesh*>(shape);
+      hashBytes(hash, &mesh->vertexCount, sizeof(mesh->vertexCount));
+      hashBytes(hash, &mesh->triangleCount, sizeof(mesh->triangleCount));
+      hashBytes(hash, mesh->vertices, 3*mesh->vertexCount*sizeof(double));
+      hashBytes(hash, mesh->triangles, 3*mesh->triangleCount*sizeof(unsigned int));
+    }
+    break;
+  default:
+    break;
+  }
+  return hash;
+}
+
+std::string collision_proximity::makeBodyDecompositionKey(const shapes::Shape* shape, 
+                                                         double resolution, 
+                                                         double padding, 
+                                                         const SphereDecompositionParameters& sphere_parameters)
+{
+  std::stringstream key;
+  key.precision(10);
+  key << std::hex << computeShapeHash(shape) << std::dec << " " << padding << " " << resolution << " " << sphere_parameters.method;
+  if(sphere_parameters.method == SphereDecompositionParameters::GREEDY_COVER) {
+    key << " " << sphere_parameters.max_error << " " << sphere_parameters.max_spheres;
+  }
+  return key.str();
+}
+
 std::vector<tf::Vector3> collision_proximity::determineCollisionPoints(const bodies::Body* body, double resolution)
+{
+  return determineCollisionPoints(body, NULL, resolution);
+}
+
+namespace
+{
+
+//finds the extent along z of the body in the column at x,y in the body frame,
+//returns false if the column misses the body
+bool getColumnExtent(const bodies::Body* body, const shapes::Shape* shape, 
+                     double x, double y, double zmin, double zmax,
+                     double& zlow, double& zhigh)
+{
+  //slightly inflated so the containment checks decide boundary cases
+  const double eps = 1e-9;
+  if(shape != NULL && shape->type == shapes::SPHERE) {
+    double radius = static_cast<const shapes::Sphere*>(shape)->radius*body->getScale()+body->getPadding()+eps;
+    double rem = radius*radius-x*x-y*y;
+    if(rem < 0.0) return false;
+    zhigh = sqrt(rem);
+    zlow = -zhigh;
+    return true;
+  } else if(shape != NULL && shape->type == shapes::BOX) {
+    const double* size = static_cast<const shapes::Box*>(shape)->size;
+    if(fabs(x) > size[0]*body->getScale()/2.0+body->getPadding()+eps ||
+       fabs(y) > size[1]*body->getScale()/2.0+body->getPadding()+eps) {
+      return false;
+    }
+    zhigh = size[2]*body->getScale()/2.0+body->getPadding()+eps;
+    zlow = -zhigh;
+    return true;
+  } else if(shape != NULL && shape->type == shapes::CYLINDER) {
+    const shapes::Cylinder* cyl = static_cast<const shapes::Cylinder*>(shape);
+    double radius = cyl->radius*body->getScale()+body->getPadding()+eps;
+    if(x*x+y*y > radius*radius) return false;
+    zhigh = cyl->length*body->getScale()/2.0+body->getPadding()+eps;
+    zlow = -zhigh;
+    return true;
+  }
+  std::vector<tf::Vector3> intersections;
+  tf::Vector3 origin = body->getPose()*tf::Vector3(x, y, zmin);
+  tf::Vector3 dir = body->getPose().getBasis()*tf::Vector3(0.0, 0.0, 1.0);
+  if(!body->intersectsRay(origin, dir, &intersections, 2) || intersections.empty()) {
+    return false;
+  }
+  tf::Transform inv = body->getPose().inverse();
+  zlow = zmax;
+  zhigh = zmin;
+  for(unsigned int i = 0; i < intersections.size(); i++) {
+    double z = (inv*intersections[i]).z();
+    zlow = std::min(zlow, z);
+    zhigh = std::max(zhigh, z);
+  }
+  return true;
+}
+
+}
+
+std::vector<tf::Vector3> collision_proximity::determineCollisionPoints(const bodies::Body* body, const shapes::Shape* shape, double resolution)
 {
   std::vector<tf::Vector3> ret_vec;
   bodies::BoundingSphere sphere;
   body->computeBoundingSphere(sphere);
   //ROS_INFO_STREAM("Radius is " << sphere.radius);
   //ROS_INFO_STREAM("Center is " << sphere.center.z() << " " << sphere.center.y() << " " << sphere.center.z());
+
+  //same lattice as a brute force walk of the bounding cube
+  std::vector<double> xvals, yvals, zvals;
   for(double xval = sphere.center.x()-sphere.radius-resolution; xval < sphere.center.x()+sphere.radius+resolution; xval += resolution) {
-    for(double yval = sphere.center.y()-sphere.radius-resolution; yval < sphere.center.y()+sphere.radius+resolution; yval += resolution) {
-      for(double zval = sphere.center.z()-sphere.radius-resolution; zval < sphere.center.z()+sphere.radius+resolution; zval += resolution) {
-        tf::Vector3 rel_vec(xval, yval, zval);
-        if(body->containsPoint(body->getPose()*rel_vec)) {
-          ret_vec.push_back(rel_vec);
-        }
+    xvals.push_back(xval);
+  }
+  for(double yval = sphere.center.y()-sphere.radius-resolution; yval < sphere.center.y()+sphere.radius+resolution; yval += resolution) {
+    yvals.push_back(yval);
+  }
+  for(double zval = sphere.center.z()-sphere.radius-resolution; zval < sphere.center.z()+sphere.radius+resolution; zval += resolution) {
+    zvals.push_back(zval);
+  }
+  if(zvals.empty()) {
+    return ret_vec;
+  }
+  int num_z = zvals.size();
+
+  for(unsigned int i = 0; i < xvals.size(); i++) {
+    for(unsigned int j = 0; j < yvals.size(); j++) {
+      double zlow, zhigh;
+      if(!getColumnExtent(body, shape, xvals[i], yvals[j], zvals.front()-resolution, zvals.back()+resolution, zlow, zhigh)) {
+        continue;
+      }
+      int low = std::max(0, (int)ceil((zlow-zvals.front())/resolution));
+      int high = std::min(num_z-1, (int)floor((zhigh-zvals.front())/resolution));
+      //the body is convex, so only the ends of the column need checking
+      while(low <= high && !body->containsPoint(body->getPose()*tf::Vector3(xvals[i], yvals[j], zvals[low]))) {
+        low++;
+      }
+      while(high >= low && !body->containsPoint(body->getPose()*tf::Vector3(xvals[i], yvals[j], zvals[high]))) {
+        high--;
+      }
+      if(low > high) {
+        continue;
+      }
+      while(low > 0 && body->containsPoint(body->getPose()*tf::Vector3(xvals[i], yvals[j], zvals[low-1]))) {
+        low--;
+      }
+      while(high < num_z-1 && body->containsPoint(body->getPose()*tf::Vector3(xvals[i], yvals[j], zvals[high+1]))) {
+        high++;
+      }
+      for(int k = low; k <= high; k++) {
+        ret_vec.push_back(tf::Vector3(xvals[i], yvals[j], zvals[k]));
       }
     }
   }
@@ -106,14 +362,29 @@ bool collision_proximity::getCollisionSphereGradients(const distance_field::Dist
   return in_collision;
 }
 
+//whether a point is at least a cell inside the field, which is where getDistanceGradient gives real values
+static bool isInFieldInterior(const distance_field::DistanceField<distance_field::PropDistanceFieldVoxel>* distance_field,
+                              const tf::Vector3& p)
+{
+  int x, y, z;
+  distance_field->worldToGrid(p.x(), p.y(), p.z(), x, y, z);
+  return (x >= 1 && y >= 1 && z >= 1 &&
+          x < distance_field->getNumCells(distance_field::PropagationDistanceField::DIM_X)-1 &&
+          y < distance_field->getNumCells(distance_field::PropagationDistanceField::DIM_Y)-1 &&
+          z < distance_field->getNumCells(distance_field::PropagationDistanceField::DIM_Z)-1);
+}
+
 bool collision_proximity::getCollisionSphereCollision(const distance_field::DistanceField<distance_field::PropDistanceFieldVoxel>* distance_field,
                                                       const std::vector<CollisionSphere>& sphere_list,
                                                       double tolerance)
 {
   for(unsigned int i = 0; i < sphere_list.size(); i++) {
     tf::Vector3 p = sphere_list[i].center_;
-    double gx, gy, gz;
-    double dist = distance_field->getDistanceGradient(p.x(), p.y(), p.z(), gx, gy, gz);
+    //like the gradient lookups, centers off the field or on its border cells count as collisions
+    if(!isInFieldInterior(distance_field, p)) {
+      return true;
+    }
+    double dist = distance_field->getDistance(p.x(), p.y(), p.z());
     if(dist - sphere_list[i].radius_ < tolerance) {
       return true;
     }
@@ -122,11 +393,98 @@ bool collision_proximity::getCollisionSphereCollision(const distance_field::Dist
 
 }
 
+bool collision_proximity::isBoundingSphereClear(const distance_field::DistanceField<distance_field::PropDistanceFieldVoxel>* distance_field,
+                                                const tf::Vector3& center,
+                                                double radius,
+                                                double tolerance)
+{
+  //lookups outside the field or on its border cells count as collisions, so the whole sphere has to be inside
+  for(int i = -1; i <= 1; i += 2) {
+    if(!isInFieldInterior(distance_field, center+tf::Vector3(i*radius, i*radius, i*radius))) {
+      return false;
+    }
+  }
+  //lookups are by cell, so allow for the cell diagonal on top of the radius
+  double cell_slop = sqrt(3.0)*distance_field->getResolution(distance_field::PropagationDistanceField::DIM_X);
+  double dist = distance_field->getDistance(center.x(), center.y(), center.z());
+  return (dist - radius - cell_slop >= tolerance);
+}
+
+void collision_proximity::setGradientClearances(const GradientInfo& env_gradient,
+                                                double max_environment_distance,
+                                                const GradientInfo& self_gradient,
+                                                double max_self_distance,
+                                                const GradientInfo& intra_gradient,
+                                                GradientInfo& gradient)
+{
+  unsigned int num_spheres = gradient.sphere_radii.size();
+  gradient.field_clearances.resize(num_spheres);
+  gradient.intra_clearances.resize(num_spheres);
+  for(unsigned int i = 0; i < num_spheres; i++) {
+    double radius = gradient.sphere_radii[i];
+    double env_clearance = env_gradient.distances[i];
+    if(env_clearance >= max_environment_distance) {
+      env_clearance = max_environment_distance-radius;
+    }
+    //spheres the self field doesn't check are left at DBL_MAX
+    double self_clearance = self_gradient.distances[i];
+    if(self_clearance >= max_self_distance && self_clearance != DBL_MAX) {
+      self_clearance = max_self_distance-radius;
+    }
+    gradient.field_clearances[i] = std::min(env_clearance, self_clearance);
+    gradient.intra_clearances[i] = intra_gradient.distances[i];
+  }
+}
+
+bool collision_proximity::areSpheresOutsideMargin(const std::vector<GradientInfo>& gradients, double margin)
+{
+  for(unsigned int i = 0; i < gradients.size(); i++) {
+    //without clearances there's nothing to show the spheres are clear
+    if(gradients[i].field_clearances.size() != gradients[i].sphere_radii.size()) {
+      return false;
+    }
+    for(unsigned int j = 0; j < gradients[i].field_clearances.size(); j++) {
+      if(std::min(gradients[i].field_clearances[j], gradients[i].intra_clearances[j]) <= margin) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool collision_proximity::areSweptSpheresCovered(const std::vector<GradientInfo>& gradients_1,
+                                                 const std::vector<GradientInfo>& gradients_2,
+                                                 const std::vector<std::vector<double> >& travel_bounds,
+                                                 double tolerance)
+{
+  double max_travel = 0.0;
+  for(unsigned int i = 0; i < travel_bounds.size(); i++) {
+    for(unsigned int j = 0; j < travel_bounds[i].size(); j++) {
+      max_travel = std::max(max_travel, travel_bounds[i][j]);
+    }
+  }
+  for(unsigned int i = 0; i < gradients_1.size(); i++) {
+    if(gradients_1[i].field_clearances.size() != gradients_1[i].sphere_radii.size() ||
+       gradients_2[i].field_clearances.size() != gradients_2[i].sphere_radii.size()) {
+      return false;
+    }
+    for(unsigned int j = 0; j < gradients_1[i].field_clearances.size(); j++) {
+      double field_clearance = gradients_1[i].field_clearances[j]+gradients_2[i].field_clearances[j]-2.0*tolerance;
+      double intra_clearance = gradients_1[i].intra_clearances[j]+gradients_2[i].intra_clearances[j]-2.0*tolerance;
+      if(travel_bounds[i][j] > field_clearance || travel_bounds[i][j]+max_travel > intra_clearance) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 ///
 /// BodyDecomposition
 ///
 
-collision_proximity::BodyDecomposition::BodyDecomposition(const std::string& object_name, const shapes::Shape* shape, double resolution, double padding) :
+collision_proximity::BodyDecomposition::BodyDecomposition(const std::string& object_name, const shapes::Shape* shape, double resolution, double padding,
+                                                          const SphereDecompositionParameters& sphere_parameters) :
   object_name_(object_name)
 {
   body_ = bodies::createBodyFromShape(shape); //unpadded
@@ -134,12 +492,47 @@ collision_proximity::BodyDecomposition::BodyDecomposition(const std::string& obj
   ident.setIdentity();
   body_->setPose(ident);
   body_->setPadding(padding);
-  collision_spheres_ = determineCollisionSpheres(body_, relative_cylinder_pose_);
-  relative_collision_points_ = determineCollisionPoints(body_, resolution);
+  relative_collision_points_ = determineCollisionPoints(body_, shape, resolution);
+  if(sphere_parameters.method == SphereDecompositionParameters::GREEDY_COVER) {
+    std::string key = makeBodyDecompositionKey(shape, resolution, padding, sphere_parameters);
+    boost::mutex::scoped_lock lock(greedy_sphere_cache_lock);
+    std::map<std::string, std::vector<CollisionSphere> >::iterator it = greedy_sphere_cache.find(key);
+    if(it != greedy_sphere_cache.end()) {
+      collision_spheres_ = it->second;
+    } else {
+      collision_spheres_ = determineCollisionSpheresGreedy(body_, relative_collision_points_, resolution,
+                                                           sphere_parameters.max_error, sphere_parameters.max_spheres);
+      greedy_sphere_cache[key] = collision_spheres_;
+    }
+    relative_cylinder_pose_ = ident;
+  }
+  //too small to have interior points, so fall back to the cylinder
+  if(collision_spheres_.empty()) {
+    collision_spheres_ = determineCollisionSpheres(body_, relative_cylinder_pose_);
+  }
   posed_collision_points_ = relative_collision_points_;
+  computeBoundingSphere();
   ROS_DEBUG_STREAM("Object " << object_name << " has " << relative_collision_points_.size() << " collision points");
 }
 
+collision_proximity::BodyDecomposition::BodyDecomposition(const std::string& object_name, const shapes::Shape* shape, double padding,
+                                                          const tf::Transform& relative_cylinder_pose,
+                                                          const std::vector<CollisionSphere>& collision_spheres,
+                                                          const std::vector<tf::Vector3>& relative_collision_points) :
+  relative_cylinder_pose_(relative_cylinder_pose),
+  object_name_(object_name),
+  collision_spheres_(collision_spheres),
+  relative_collision_points_(relative_collision_points)
+{
+  body_ = bodies::createBodyFromShape(shape);
+  tf::Transform ident;
+  ident.setIdentity();
+  body_->setPose(ident);
+  body_->setPadding(padding);
+  posed_collision_points_ = relative_collision_points_;
+  computeBoundingSphere();
+}
+
 collision_proximity::BodyDecomposition::~BodyDecomposition()
 {
   delete body_;
@@ -152,6 +545,25 @@ void collision_proximity::BodyDecomposition::updateSpheresPose(const tf::Transfo
   for(unsigned int i = 0; i < collision_spheres_.size(); i++) {
     collision_spheres_[i].center_ = cylTransform*collision_spheres_[i].relative_vec_;
   }
+  bounding_sphere_center_ = cylTransform*relative_bounding_sphere_center_;
+}
+
+void collision_proximity::BodyDecomposition::computeBoundingSphere()
+{
+  relative_bounding_sphere_center_.setValue(0.0, 0.0, 0.0);
+  bounding_sphere_radius_ = 0.0;
+  if(collision_spheres_.empty()) {
+    return;
+  }
+  for(unsigned int i = 0; i < collision_spheres_.size(); i++) {
+    relative_bounding_sphere_center_ += collision_spheres_[i].relative_vec_;
+  }
+  relative_bounding_sphere_center_ /= collision_spheres_.size();
+  for(unsigned int i = 0; i < collision_spheres_.size(); i++) {
+    bounding_sphere_radius_ = std::max(bounding_sphere_radius_, 
+                                       relative_bounding_sphere_center_.distance(collision_spheres_[i].relative_vec_)+collision_spheres_[i].radius_);
+  }
+  bounding_sphere_center_ = relative_cylinder_pose_*relative_bounding_sphere_center_;
 }
 
 void collision_proximity::BodyDecomposition::updatePointsPose(const tf::Transform& trans) {
@@ -169,3 +581,61 @@ void collision_proximity::BodyDecomposition::updatePose(const tf::Transform& tra
   updateSpheresPose(trans);
   updatePointsPose(trans);
 }
+
+///
+/// LocalDistanceField
+///
+
+collision_proximity::LocalDistanceField::LocalDistanceField(const std::vector<tf::Vector3>& relative_points, 
+                                                            double resolution, 
+                                                            double max_distance) :
+  max_distance_(max_distance),
+  bounding_radius_(0.0)
+{
+  tf::Vector3 min_point(0.0,0.0,0.0), max_point(0.0,0.0,0.0);
+  if(!relative_points.empty()) {
+    min_point = max_point = relative_points[0];
+  }
+  for(unsigned int i = 1; i < relative_points.size(); i++) {
+    min_point.setValue(std::min(min_point.x(), relative_points[i].x()),
+                       std::min(min_point.y(), relative_points[i].y()),
+                       std::min(min_point.z(), relative_points[i].z()));
+    max_point.setValue(std::max(max_point.x(), relative_points[i].x()),
+                       std::max(max_point.y(), relative_points[i].y()),
+                       std::max(max_point.z(), relative_points[i].z()));
+  }
+  bounding_center_ = (min_point+max_point)/2.0;
+  for(unsigned int i = 0; i < relative_points.size(); i++) {
+    bounding_radius_ = std::max(bounding_radius_, bounding_center_.distance(relative_points[i]));
+  }
+  //room for the full max distance plus the cell needed for gradients
+  double margin = max_distance+2.0*resolution;
+  tf::Vector3 size = max_point-min_point+tf::Vector3(2.0*margin, 2.0*margin, 2.0*margin);
+  distance_field_ = new distance_field::PropagationDistanceField(size.x(), size.y(), size.z(), resolution,
+                                                                 min_point.x()-margin, min_point.y()-margin, min_point.z()-margin,
+                                                                 max_distance);
+  distance_field_->reset();
+  distance_field_->addPointsToField(relative_points);
+}
+
+collision_proximity::LocalDistanceField::~LocalDistanceField()
+{
+  delete distance_field_;
+}
+
+double collision_proximity::LocalDistanceField::getDistanceGradient(const tf::Vector3& point, tf::Vector3& gradient) const
+{
+  int x, y, z;
+  distance_field_->worldToGrid(point.x(), point.y(), point.z(), x, y, z);
+  if(x < 1 || y < 1 || z < 1 ||
+     x >= distance_field_->getNumCells(distance_field::PropagationDistanceField::DIM_X)-1 ||
+     y >= distance_field_->getNumCells(distance_field::PropagationDistanceField::DIM_Y)-1 ||
+     z >= distance_field_->getNumCells(distance_field::PropagationDistanceField::DIM_Z)-1) {
+    gradient.setValue(0.0, 0.0, 0.0);
+    return max_distance_;
+  }
+  double gx, gy, gz;
+  double dist = distance_field_->getDistanceGradient(point.x(), point.y(), point.z(), gx, gy, gz);
+  gradient.setValue(gx, gy, gz);
+  return dist;
+}
@@ -0,0 +1,147 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+#include <cmath>
+#include <collision_proximity/gradient_cache.h>
+
+using namespace collision_proximity;
+
+GradientCache::GradientCache() :
+  max_size_(0),
+  quantization_(1e-5),
+  generation_(0),
+  hits_(0),
+  misses_(0)
+{
+}
+
+void GradientCache::setParameters(unsigned int max_size, double quantization)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  max_size_ = max_size;
+  if(quantization > 0.0) {
+    quantization_ = quantization;
+  }
+  use_order_.clear();
+  entries_.clear();
+}
+
+unsigned int GradientCache::getGeneration() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return generation_;
+}
+
+GradientCache::Key GradientCache::makeKey(const std::vector<double>& joint_values, bool subtract_radii) const
+{
+  Key key;
+  key.subtract_radii = subtract_radii;
+  key.joint_values.resize(joint_values.size());
+  for(unsigned int i = 0; i < joint_values.size(); i++) {
+    key.joint_values[i] = lround(joint_values[i]/quantization_);
+  }
+  return key;
+}
+
+bool GradientCache::lookup(const std::vector<double>& joint_values,
+                           bool subtract_radii,
+                           std::vector<GradientInfo>& gradients,
+                           bool& in_collision)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if(max_size_ == 0) {
+    return false;
+  }
+  std::map<Key, Entry>::iterator it = entries_.find(makeKey(joint_values, subtract_radii));
+  if(it == entries_.end()) {
+    misses_++;
+    return false;
+  }
+  hits_++;
+  use_order_.splice(use_order_.begin(), use_order_, it->second.use_position);
+  gradients = it->second.gradients;
+  in_collision = it->second.in_collision;
+  return true;
+}
+
+void GradientCache::insert(unsigned int generation,
+                           const std::vector<double>& joint_values,
+                           bool subtract_radii,
+                           const std::vector<GradientInfo>& gradients,
+                           bool in_collision)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if(max_size_ == 0 || generation != generation_) {
+    return;
+  }
+  Key key = makeKey(joint_values, subtract_radii);
+  std::map<Key, Entry>::iterator it = entries_.find(key);
+  if(it != entries_.end()) {
+    //another thread got there first
+    use_order_.splice(use_order_.begin(), use_order_, it->second.use_position);
+    return;
+  }
+  if(entries_.size() >= max_size_) {
+    entries_.erase(use_order_.back());
+    use_order_.pop_back();
+  }
+  use_order_.push_front(key);
+  Entry& entry = entries_[key];
+  entry.gradients = gradients;
+  entry.in_collision = in_collision;
+  entry.use_position = use_order_.begin();
+}
+
+void GradientCache::invalidate()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  generation_++;
+  use_order_.clear();
+  entries_.clear();
+}
+
+unsigned long GradientCache::getHits() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return hits_;
+}
+
+unsigned long GradientCache::getMisses() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return misses_;
+}
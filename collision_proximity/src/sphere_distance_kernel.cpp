@@ -0,0 +1,249 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+#include <cfloat>
+#include <collision_proximity/sphere_distance_kernel.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace collision_proximity;
+
+namespace
+{
+
+//far enough from any robot that padding spheres never end up closest,
+//small enough that the squared distance stays finite in float
+const float PADDING_COORDINATE = 1e15f;
+
+//margin over the float distances before spheres get an exact check
+const double FLOAT_SLACK = 1e-4;
+
+#if defined(__SSE2__)
+
+inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128i select(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+void computeRowDistances(const SphereBlock& rows,
+                         const SphereBlock& columns,
+                         bool subtract_radii,
+                         unsigned int row,
+                         SphereBlockDistances& distances)
+{
+  const __m128 rx = _mm_set1_ps(rows.x[row]);
+  const __m128 ry = _mm_set1_ps(rows.y[row]);
+  const __m128 rz = _mm_set1_ps(rows.z[row]);
+  const __m128 rr = _mm_set1_ps(rows.radius[row]);
+  const __m128i row_index = _mm_set1_epi32(row);
+  const __m128i step = _mm_set1_epi32(SPHERE_BLOCK_WIDTH);
+  __m128 best = _mm_set1_ps(FLT_MAX);
+  __m128i best_index = _mm_setzero_si128();
+  __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+  for(unsigned int j = 0; j < columns.x.size(); j += SPHERE_BLOCK_WIDTH) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(&columns.x[j]), rx);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(&columns.y[j]), ry);
+    __m128 dz = _mm_sub_ps(_mm_loadu_ps(&columns.z[j]), rz);
+    __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+    if(subtract_radii) {
+      dist = _mm_sub_ps(_mm_sub_ps(dist, rr), _mm_loadu_ps(&columns.radius[j]));
+    }
+    __m128 closer = _mm_cmplt_ps(dist, best);
+    best = select(closer, dist, best);
+    best_index = select(_mm_castps_si128(closer), index, best_index);
+
+    __m128 column_best = _mm_loadu_ps(&distances.column_distances[j]);
+    __m128 column_closer = _mm_cmplt_ps(dist, column_best);
+    _mm_storeu_ps(&distances.column_distances[j], select(column_closer, dist, column_best));
+    __m128i* column_index = reinterpret_cast<__m128i*>(&distances.column_closest[j]);
+    _mm_storeu_si128(column_index, select(_mm_castps_si128(column_closer), row_index, _mm_loadu_si128(column_index)));
+
+    index = _mm_add_epi32(index, step);
+  }
+  float lane_best[SPHERE_BLOCK_WIDTH];
+  unsigned int lane_index[SPHERE_BLOCK_WIDTH];
+  _mm_storeu_ps(lane_best, best);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_index), best_index);
+  //ties go to the lowest index, same as a sequential scan
+  for(unsigned int l = 0; l < SPHERE_BLOCK_WIDTH; l++) {
+    if(lane_best[l] < distances.row_distances[row] ||
+       (lane_best[l] == distances.row_distances[row] && lane_index[l] < distances.row_closest[row])) {
+      distances.row_distances[row] = lane_best[l];
+      distances.row_closest[row] = lane_index[l];
+    }
+  }
+}
+
+#else
+
+void computeRowDistances(const SphereBlock& rows,
+                         const SphereBlock& columns,
+                         bool subtract_radii,
+                         unsigned int row,
+                         SphereBlockDistances& distances)
+{
+  for(unsigned int j = 0; j < columns.x.size(); j++) {
+    float dx = columns.x[j]-rows.x[row];
+    float dy = columns.y[j]-rows.y[row];
+    float dz = columns.z[j]-rows.z[row];
+    float dist = sqrtf(dx*dx+dy*dy+dz*dz);
+    if(subtract_radii) {
+      dist = dist-rows.radius[row]-columns.radius[j];
+    }
+    if(dist < distances.row_distances[row]) {
+      distances.row_distances[row] = dist;
+      distances.row_closest[row] = j;
+    }
+    if(dist < distances.column_distances[j]) {
+      distances.column_distances[j] = dist;
+      distances.column_closest[j] = row;
+    }
+  }
+}
+
+#endif
+
+}
+
+void SphereBlock::setSpheres(const std::vector<CollisionSphere>& spheres)
+{
+  size = spheres.size();
+  unsigned int padded = ((size+SPHERE_BLOCK_WIDTH-1)/SPHERE_BLOCK_WIDTH)*SPHERE_BLOCK_WIDTH;
+  x.assign(padded, PADDING_COORDINATE);
+  y.assign(padded, 0.0f);
+  z.assign(padded, 0.0f);
+  radius.assign(padded, 0.0f);
+  for(unsigned int i = 0; i < size; i++) {
+    x[i] = spheres[i].center_.x();
+    y[i] = spheres[i].center_.y();
+    z[i] = spheres[i].center_.z();
+    radius[i] = spheres[i].radius_;
+  }
+}
+
+void collision_proximity::computeSphereBlockDistances(const SphereBlock& rows,
+                                                      const SphereBlock& columns,
+                                                      bool subtract_radii,
+                                                      SphereBlockDistances& distances)
+{
+  distances.row_distances.assign(rows.size, FLT_MAX);
+  distances.row_closest.assign(rows.size, 0);
+  distances.column_distances.assign(columns.x.size(), FLT_MAX);
+  distances.column_closest.assign(columns.x.size(), 0);
+  for(unsigned int i = 0; i < rows.size; i++) {
+    computeRowDistances(rows, columns, subtract_radii, i, distances);
+  }
+  distances.column_distances.resize(columns.size);
+  distances.column_closest.resize(columns.size);
+}
+
+bool collision_proximity::areSphereBlocksInCollision(const std::vector<CollisionSphere>& row_spheres,
+                                                     const SphereBlock& rows,
+                                                     const std::vector<CollisionSphere>& column_spheres,
+                                                     const SphereBlock& columns,
+                                                     double tolerance,
+                                                     SphereBlockDistances& distances)
+{
+  computeSphereBlockDistances(rows, columns, true, distances);
+  for(unsigned int k = 0; k < row_spheres.size(); k++) {
+    if(distances.row_distances[k] > tolerance+FLOAT_SLACK) continue;
+    for(unsigned int l = 0; l < column_spheres.size(); l++) {
+      //compared squared to avoid the square root
+      double touch_dist = row_spheres[k].radius_+column_spheres[l].radius_+tolerance;
+      if(touch_dist >= 0.0 && row_spheres[k].center_.distance2(column_spheres[l].center_) <= touch_dist*touch_dist) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool collision_proximity::updateSphereBlockGradients(const std::vector<CollisionSphere>& row_spheres,
+                                                     const SphereBlock& rows,
+                                                     const std::vector<CollisionSphere>& column_spheres,
+                                                     const SphereBlock& columns,
+                                                     bool subtract_radii,
+                                                     double tolerance,
+                                                     GradientInfo& row_gradient,
+                                                     GradientInfo& column_gradient,
+                                                     SphereBlockDistances& distances)
+{
+  if(row_spheres.empty() || column_spheres.empty()) {
+    return false;
+  }
+  computeSphereBlockDistances(rows, columns, subtract_radii, distances);
+  bool in_collision = false;
+  for(unsigned int k = 0; k < row_spheres.size(); k++) {
+    const CollisionSphere& closest = column_spheres[distances.row_closest[k]];
+    double dist = row_spheres[k].center_.distance(closest.center_);
+    if(subtract_radii) {
+      dist += -row_spheres[k].radius_-closest.radius_;
+      if(dist <= tolerance) {
+        in_collision = true;
+      }
+    }
+    if(dist < row_gradient.distances[k]) {
+      row_gradient.distances[k] = dist;
+      row_gradient.gradients[k] = row_spheres[k].center_-closest.center_;
+    }
+    if(dist < row_gradient.closest_distance) {
+      row_gradient.closest_distance = dist;
+    }
+  }
+  for(unsigned int l = 0; l < column_spheres.size(); l++) {
+    const CollisionSphere& closest = row_spheres[distances.column_closest[l]];
+    double dist = column_spheres[l].center_.distance(closest.center_);
+    if(subtract_radii) {
+      dist += -column_spheres[l].radius_-closest.radius_;
+    }
+    if(dist < column_gradient.distances[l]) {
+      column_gradient.distances[l] = dist;
+      column_gradient.gradients[l] = column_spheres[l].center_-closest.center_;
+    }
+    if(dist < column_gradient.closest_distance) {
+      column_gradient.closest_distance = dist;
+    }
+  }
+  return in_collision;
+}
@@ -0,0 +1,159 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+/** \author E. Gil Jones */
+
+#include <algorithm>
+#include <gtest/gtest.h>
+
+#include <collision_proximity/collision_proximity_types.h>
+
+using namespace collision_proximity;
+
+//every lattice point in the bounding cube of the body that the body contains
+static std::vector<tf::Vector3> determineCollisionPointsBruteForce(const bodies::Body* body, double resolution)
+{
+  std::vector<tf::Vector3> ret_vec;
+  bodies::BoundingSphere sphere;
+  body->computeBoundingSphere(sphere);
+  for(double xval = sphere.center.x()-sphere.radius-resolution; xval < sphere.center.x()+sphere.radius+resolution; xval += resolution) {
+    for(double yval = sphere.center.y()-sphere.radius-resolution; yval < sphere.center.y()+sphere.radius+resolution; yval += resolution) {
+      for(double zval = sphere.center.z()-sphere.radius-resolution; zval < sphere.center.z()+sphere.radius+resolution; zval += resolution) {
+        tf::Vector3 rel_vec(xval, yval, zval);
+        if(body->containsPoint(body->getPose()*rel_vec)) {
+          ret_vec.push_back(rel_vec);
+        }
+      }
+    }
+  }
+  return ret_vec;
+}
+
+static bool isPointLess(const tf::Vector3& p1, const tf::Vector3& p2)
+{
+  if(p1.x() != p2.x()) return p1.x() < p2.x();
+  if(p1.y() != p2.y()) return p1.y() < p2.y();
+  return p1.z() < p2.z();
+}
+
+//the points of both methods have to be the same lattice points, not just close
+static void expectSamePoints(std::vector<tf::Vector3> expected, std::vector<tf::Vector3> points)
+{
+  std::sort(expected.begin(), expected.end(), isPointLess);
+  std::sort(points.begin(), points.end(), isPointLess);
+  ASSERT_EQ(points.size(), expected.size());
+  for(unsigned int i = 0; i < points.size(); i++) {
+    EXPECT_EQ(points[i].x(), expected[i].x());
+    EXPECT_EQ(points[i].y(), expected[i].y());
+    EXPECT_EQ(points[i].z(), expected[i].z());
+  }
+}
+
+//compares the column voxelizer, in closed form and by ray casting, against the
+//brute force scan of the lattice with and without padding
+static void checkShape(const shapes::Shape* shape)
+{
+  const double resolutions[] = {0.01, 0.023};
+  const double paddings[] = {0.0, 0.01};
+  for(unsigned int i = 0; i < 2; i++) {
+    for(unsigned int j = 0; j < 2; j++) {
+      SCOPED_TRACE(testing::Message() << "resolution " << resolutions[i] << " padding " << paddings[j]);
+      bodies::Body* body = bodies::createBodyFromShape(shape);
+      ASSERT_TRUE(body != NULL);
+      tf::Transform ident;
+      ident.setIdentity();
+      body->setPose(ident);
+      body->setPadding(paddings[j]);
+      std::vector<tf::Vector3> expected = determineCollisionPointsBruteForce(body, resolutions[i]);
+      EXPECT_FALSE(expected.empty());
+      expectSamePoints(expected, determineCollisionPoints(body, shape, resolutions[i]));
+      expectSamePoints(expected, determineCollisionPoints(body, resolutions[i]));
+      delete body;
+    }
+  }
+}
+
+TEST(TestCollisionPoints, TestBox)
+{
+  shapes::Box box(0.1, 0.2, 0.14);
+  checkShape(&box);
+}
+
+TEST(TestCollisionPoints, TestCylinder)
+{
+  shapes::Cylinder cylinder(0.083, 0.3);
+  checkShape(&cylinder);
+}
+
+TEST(TestCollisionPoints, TestSphere)
+{
+  shapes::Sphere sphere(0.083);
+  checkShape(&sphere);
+}
+
+TEST(TestCollisionPoints, TestConvexMesh)
+{
+  //an octahedron, which has no faces along the lattice
+  const double vertices[6][3] = {{0.1, 0.0, 0.0}, {-0.1, 0.0, 0.0},
+                                 {0.0, 0.15, 0.0}, {0.0, -0.15, 0.0},
+                                 {0.0, 0.0, 0.12}, {0.0, 0.0, -0.12}};
+  const unsigned int triangles[8][3] = {{0, 2, 4}, {2, 1, 4}, {1, 3, 4}, {3, 0, 4},
+                                        {2, 0, 5}, {1, 2, 5}, {3, 1, 5}, {0, 3, 5}};
+  shapes::Mesh mesh(6, 8);
+  for(unsigned int i = 0; i < 6; i++) {
+    for(unsigned int j = 0; j < 3; j++) {
+      mesh.vertices[3*i+j] = vertices[i][j];
+    }
+  }
+  for(unsigned int i = 0; i < 8; i++) {
+    tf::Vector3 v0(vertices[triangles[i][0]][0], vertices[triangles[i][0]][1], vertices[triangles[i][0]][2]);
+    tf::Vector3 v1(vertices[triangles[i][1]][0], vertices[triangles[i][1]][1], vertices[triangles[i][1]][2]);
+    tf::Vector3 v2(vertices[triangles[i][2]][0], vertices[triangles[i][2]][1], vertices[triangles[i][2]][2]);
+    tf::Vector3 normal = (v1-v0).cross(v2-v0).normalized();
+    for(unsigned int j = 0; j < 3; j++) {
+      mesh.triangles[3*i+j] = triangles[i][j];
+      mesh.normals[3*i+j] = normal[j];
+    }
+  }
+  checkShape(&mesh);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
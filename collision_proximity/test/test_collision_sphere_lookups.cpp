@@ -0,0 +1,100 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+#include <gtest/gtest.h>
+
+#include <collision_proximity/collision_proximity_types.h>
+#include <distance_field/propagation_distance_field.h>
+
+using namespace collision_proximity;
+using namespace distance_field;
+
+static const double size = 1.0;
+static const double resolution = 0.05;
+static const double max_dist = 0.3;
+
+static CollisionSphere makeSphere(const tf::Vector3& center, double radius)
+{
+  CollisionSphere sphere(tf::Vector3(0.0, 0.0, 0.0), radius);
+  sphere.center_ = center;
+  return sphere;
+}
+
+TEST(TestCollisionSphereLookups, TestSphereInFreeSpace)
+{
+  PropagationDistanceField df(size, size, size, resolution, 0.0, 0.0, 0.0, max_dist);
+  df.reset();
+  std::vector<tf::Vector3> points(1, tf::Vector3(0.2, 0.2, 0.2));
+  df.addPointsToField(points);
+
+  std::vector<CollisionSphere> spheres(1, makeSphere(tf::Vector3(0.7, 0.7, 0.7), 0.05));
+  EXPECT_FALSE(getCollisionSphereCollision(&df, spheres, 0.0));
+  EXPECT_TRUE(isBoundingSphereClear(&df, spheres[0].center_, spheres[0].radius_, 0.0));
+
+  spheres[0] = makeSphere(tf::Vector3(0.25, 0.2, 0.2), 0.1);
+  EXPECT_TRUE(getCollisionSphereCollision(&df, spheres, 0.0));
+  EXPECT_FALSE(isBoundingSphereClear(&df, spheres[0].center_, spheres[0].radius_, 0.0));
+}
+
+TEST(TestCollisionSphereLookups, TestSphereOutsideField)
+{
+  PropagationDistanceField df(size, size, size, resolution, 0.0, 0.0, 0.0, max_dist);
+  df.reset();
+
+  // with no obstacles every lookup inside the field is at the maximum distance, but spheres
+  // off the field or on its border cells can't be shown to be clear
+  std::vector<CollisionSphere> spheres(1, makeSphere(tf::Vector3(0.5, 0.5, 0.5), 0.05));
+  EXPECT_FALSE(getCollisionSphereCollision(&df, spheres, 0.0));
+
+  spheres.push_back(makeSphere(tf::Vector3(1.5, 0.5, 0.5), 0.05));
+  EXPECT_TRUE(getCollisionSphereCollision(&df, spheres, 0.0));
+
+  spheres[1] = makeSphere(tf::Vector3(0.5, -0.2, 0.5), 0.05);
+  EXPECT_TRUE(getCollisionSphereCollision(&df, spheres, 0.0));
+
+  spheres[1] = makeSphere(tf::Vector3(0.5, 0.5, 0.2*resolution), 0.01);
+  EXPECT_TRUE(getCollisionSphereCollision(&df, spheres, 0.0));
+
+  EXPECT_FALSE(isBoundingSphereClear(&df, tf::Vector3(1.5, 0.5, 0.5), 0.05, 0.0));
+  EXPECT_FALSE(isBoundingSphereClear(&df, tf::Vector3(0.5, 0.5, 0.02), 0.05, 0.0));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,180 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+/** \author E. Gil Jones */
+
+#include <gtest/gtest.h>
+
+#include <collision_proximity/gradient_cache.h>
+
+using namespace collision_proximity;
+
+static const double quantization = 1e-3;
+
+static std::vector<double> makeJointValues(double v1, double v2)
+{
+  std::vector<double> joint_values(2);
+  joint_values[0] = v1;
+  joint_values[1] = v2;
+  return joint_values;
+}
+
+//gradients that can be told apart by their closest distance
+static std::vector<GradientInfo> makeGradients(double closest_distance)
+{
+  std::vector<GradientInfo> gradients(1);
+  gradients[0].closest_distance = closest_distance;
+  gradients[0].distances.resize(1, closest_distance);
+  gradients[0].gradients.resize(1, tf::Vector3(1.0, 0.0, 0.0));
+  return gradients;
+}
+
+static void insertGradients(GradientCache& cache, const std::vector<double>& joint_values, double closest_distance)
+{
+  cache.insert(cache.getGeneration(), joint_values, true, makeGradients(closest_distance), false);
+}
+
+//the closest distance of the entry for the joint values, or -1 if there isn't one
+static double lookupDistance(GradientCache& cache, const std::vector<double>& joint_values, bool subtract_radii = true)
+{
+  std::vector<GradientInfo> gradients;
+  bool in_collision;
+  if(!cache.lookup(joint_values, subtract_radii, gradients, in_collision)) {
+    return -1.0;
+  }
+  return gradients[0].closest_distance;
+}
+
+TEST(TestGradientCache, TestDisabled)
+{
+  GradientCache cache;
+  EXPECT_FALSE(cache.isEnabled());
+  insertGradients(cache, makeJointValues(0.1, 0.2), 0.5);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1, 0.2)), -1.0);
+}
+
+TEST(TestGradientCache, TestHits)
+{
+  GradientCache cache;
+  cache.setParameters(10, quantization);
+  ASSERT_TRUE(cache.isEnabled());
+
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1, 0.2)), -1.0);
+  EXPECT_EQ(cache.getMisses(), 1u);
+
+  std::vector<GradientInfo> gradients = makeGradients(0.5);
+  gradients[0].field_clearances.resize(1, 0.4);
+  gradients[0].intra_clearances.resize(1, 0.6);
+  cache.insert(cache.getGeneration(), makeJointValues(0.1, 0.2), true, gradients, true);
+
+  std::vector<GradientInfo> cached;
+  bool in_collision = false;
+  ASSERT_TRUE(cache.lookup(makeJointValues(0.1, 0.2), true, cached, in_collision));
+  EXPECT_EQ(cache.getHits(), 1u);
+  EXPECT_TRUE(in_collision);
+  ASSERT_EQ(cached.size(), 1u);
+  EXPECT_EQ(cached[0].closest_distance, 0.5);
+  ASSERT_EQ(cached[0].field_clearances.size(), 1u);
+  EXPECT_EQ(cached[0].field_clearances[0], 0.4);
+  EXPECT_EQ(cached[0].intra_clearances[0], 0.6);
+
+  //entries are kept apart by whether the radii were subtracted, and by the number of joints
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1, 0.2), false), -1.0);
+  EXPECT_EQ(lookupDistance(cache, std::vector<double>(1, 0.1)), -1.0);
+}
+
+TEST(TestGradientCache, TestQuantization)
+{
+  GradientCache cache;
+  cache.setParameters(10, quantization);
+  insertGradients(cache, makeJointValues(0.1, 0.2), 0.5);
+
+  //values that round to the same step share the entry
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1+0.4*quantization, 0.2-0.4*quantization)), 0.5);
+  //ones that round to the next don't
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1+0.6*quantization, 0.2)), -1.0);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1, 0.2-0.6*quantization)), -1.0);
+  //nor do negated ones
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(-0.1, 0.2)), -1.0);
+}
+
+TEST(TestGradientCache, TestEviction)
+{
+  GradientCache cache;
+  cache.setParameters(3, quantization);
+  insertGradients(cache, makeJointValues(0.1, 0.0), 0.1);
+  insertGradients(cache, makeJointValues(0.2, 0.0), 0.2);
+  insertGradients(cache, makeJointValues(0.3, 0.0), 0.3);
+
+  //using the oldest entry makes the second the least recently used
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1, 0.0)), 0.1);
+  insertGradients(cache, makeJointValues(0.4, 0.0), 0.4);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.2, 0.0)), -1.0);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1, 0.0)), 0.1);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.3, 0.0)), 0.3);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.4, 0.0)), 0.4);
+
+  //reinserting an entry keeps the first gradients and just marks it used
+  insertGradients(cache, makeJointValues(0.1, 0.0), 1.0);
+  insertGradients(cache, makeJointValues(0.5, 0.0), 0.5);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1, 0.0)), 0.1);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.3, 0.0)), -1.0);
+}
+
+TEST(TestGradientCache, TestGenerations)
+{
+  GradientCache cache;
+  cache.setParameters(10, quantization);
+  insertGradients(cache, makeJointValues(0.1, 0.2), 0.5);
+
+  //gradients found before an invalidation are neither kept nor stored
+  unsigned int generation = cache.getGeneration();
+  cache.invalidate();
+  EXPECT_NE(cache.getGeneration(), generation);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1, 0.2)), -1.0);
+  cache.insert(generation, makeJointValues(0.1, 0.2), true, makeGradients(0.5), false);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1, 0.2)), -1.0);
+
+  insertGradients(cache, makeJointValues(0.1, 0.2), 0.7);
+  EXPECT_EQ(lookupDistance(cache, makeJointValues(0.1, 0.2)), 0.7);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
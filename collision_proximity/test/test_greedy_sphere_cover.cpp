@@ -0,0 +1,119 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+/** \author E. Gil Jones */
+
+#include <gtest/gtest.h>
+
+#include <collision_proximity/collision_proximity_types.h>
+
+using namespace collision_proximity;
+
+static const double resolution = 0.01;
+static const double max_error = 0.01;
+
+//the number of points that aren't inside any of the spheres
+static unsigned int countUncoveredPoints(const std::vector<tf::Vector3>& points,
+                                         const std::vector<CollisionSphere>& spheres)
+{
+  unsigned int num_uncovered = 0;
+  for(unsigned int i = 0; i < points.size(); i++) {
+    bool covered = false;
+    for(unsigned int j = 0; j < spheres.size() && !covered; j++) {
+      covered = (spheres[j].relative_vec_.distance(points[i]) <= spheres[j].radius_+1e-9);
+    }
+    if(!covered) {
+      num_uncovered++;
+    }
+  }
+  return num_uncovered;
+}
+
+class TestGreedySphereCover : public testing::Test
+{
+protected:
+
+  virtual void SetUp() {
+    box_.size[0] = 0.1;
+    box_.size[1] = 0.2;
+    box_.size[2] = 0.14;
+    body_ = bodies::createBodyFromShape(&box_);
+    tf::Transform ident;
+    ident.setIdentity();
+    body_->setPose(ident);
+    points_ = determineCollisionPoints(body_, resolution);
+  }
+
+  virtual void TearDown() {
+    delete body_;
+  }
+
+  shapes::Box box_;
+  bodies::Body* body_;
+  std::vector<tf::Vector3> points_;
+};
+
+TEST_F(TestGreedySphereCover, TestCoverWithinBound)
+{
+  ASSERT_FALSE(points_.empty());
+  std::vector<CollisionSphere> spheres = determineCollisionSpheresGreedy(body_, points_, resolution, max_error, 1000);
+  ASSERT_FALSE(spheres.empty());
+  ASSERT_LT(spheres.size(), 1000u);
+  EXPECT_EQ(countUncoveredPoints(points_, spheres), 0u);
+
+  //no sphere is bigger than the largest ball in the box, plus the allowed error
+  for(unsigned int i = 0; i < spheres.size(); i++) {
+    EXPECT_LE(spheres[i].radius_, 0.05+max_error+1e-9);
+  }
+}
+
+TEST_F(TestGreedySphereCover, TestCoverOutOfBudget)
+{
+  ASSERT_FALSE(points_.empty());
+  for(unsigned int max_spheres = 1; max_spheres <= 4; max_spheres++) {
+    std::vector<CollisionSphere> spheres = determineCollisionSpheresGreedy(body_, points_, resolution, max_error, max_spheres);
+    ASSERT_FALSE(spheres.empty());
+    EXPECT_LE(spheres.size(), max_spheres);
+    EXPECT_EQ(countUncoveredPoints(points_, spheres), 0u) << "with " << max_spheres << " spheres";
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
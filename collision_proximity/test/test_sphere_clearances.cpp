@@ -0,0 +1,169 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+/** \author E. Gil Jones */
+
+#include <gtest/gtest.h>
+
+#include <collision_proximity/collision_proximity_types.h>
+#include <distance_field/propagation_distance_field.h>
+
+using namespace collision_proximity;
+using namespace distance_field;
+
+static const double size = 1.0;
+static const double resolution = 0.05;
+static const double max_dist = 0.3;
+static const double radius = 0.05;
+
+//the gradient of a single link whose spheres are only near the environment, as
+//computeStateGradients would merge it
+static GradientInfo makeGradient(const PropagationDistanceField& df,
+                                 const std::vector<tf::Vector3>& centers,
+                                 const std::vector<double>& intra_distances)
+{
+  std::vector<CollisionSphere> spheres;
+  for(unsigned int i = 0; i < centers.size(); i++) {
+    spheres.push_back(CollisionSphere(tf::Vector3(0.0, 0.0, 0.0), radius));
+    spheres.back().center_ = centers[i];
+  }
+  GradientInfo env_gradient, self_gradient, intra_gradient, gradient;
+  env_gradient.distances.resize(centers.size(), DBL_MAX);
+  env_gradient.gradients.resize(centers.size());
+  getCollisionSphereGradients(&df, spheres, env_gradient, 0.0, true, max_dist, false);
+  self_gradient.distances.resize(centers.size(), DBL_MAX);
+  intra_gradient.distances = intra_distances;
+  gradient.sphere_radii.resize(centers.size(), radius);
+  setGradientClearances(env_gradient, max_dist, self_gradient, max_dist, intra_gradient, gradient);
+  return gradient;
+}
+
+static GradientInfo makeGradient(const PropagationDistanceField& df, const tf::Vector3& center)
+{
+  return makeGradient(df, std::vector<tf::Vector3>(1, center), std::vector<double>(1, DBL_MAX));
+}
+
+TEST(TestSphereClearances, TestSaturatedClearance)
+{
+  PropagationDistanceField df(size, size, size, resolution, 0.0, 0.0, 0.0, max_dist);
+  df.reset();
+  std::vector<tf::Vector3> points(1, tf::Vector3(0.5, 0.5, 0.5));
+  df.addPointsToField(points);
+
+  //far from the point the field only shows the center is max_dist from everything
+  GradientInfo gradient = makeGradient(df, tf::Vector3(0.1, 0.1, 0.1));
+  ASSERT_EQ(gradient.field_clearances.size(), 1u);
+  EXPECT_NEAR(gradient.field_clearances[0], max_dist-radius, 1e-9);
+  EXPECT_EQ(gradient.intra_clearances[0], DBL_MAX);
+
+  //near it the measured distance has the radius taken off
+  gradient = makeGradient(df, tf::Vector3(0.5, 0.5, 0.7));
+  EXPECT_NEAR(gradient.field_clearances[0], 0.2-radius, 1e-9);
+}
+
+TEST(TestSphereClearances, TestThinObstacleBetweenClearSamples)
+{
+  PropagationDistanceField df(size, size, size, resolution, 0.0, 0.0, 0.0, max_dist);
+  df.reset();
+
+  std::vector<std::vector<double> > travel_bounds(1, std::vector<double>(1, 0.7));
+  std::vector<GradientInfo> gradients_1(1, makeGradient(df, tf::Vector3(0.15, 0.5, 0.5)));
+  std::vector<GradientInfo> gradients_2(1, makeGradient(df, tf::Vector3(0.85, 0.5, 0.5)));
+
+  //a wall one cell thick between the two ends, which are both saturated
+  std::vector<tf::Vector3> points;
+  for(double y = 0.0; y < size; y += resolution) {
+    for(double z = 0.0; z < size; z += resolution) {
+      points.push_back(tf::Vector3(0.5, y, z));
+    }
+  }
+  df.addPointsToField(points);
+  gradients_1[0] = makeGradient(df, tf::Vector3(0.15, 0.5, 0.5));
+  gradients_2[0] = makeGradient(df, tf::Vector3(0.85, 0.5, 0.5));
+  EXPECT_FALSE(areSweptSpheresCovered(gradients_1, gradients_2, travel_bounds, 0.0));
+
+  //ends close enough together are covered by the saturated clearance alone
+  travel_bounds[0][0] = 0.3;
+  gradients_1[0] = makeGradient(df, tf::Vector3(0.1, 0.5, 0.5));
+  gradients_2[0] = makeGradient(df, tf::Vector3(0.1, 0.5, 0.8));
+  EXPECT_TRUE(areSweptSpheresCovered(gradients_1, gradients_2, travel_bounds, 0.0));
+  EXPECT_FALSE(areSweptSpheresCovered(gradients_1, gradients_2, travel_bounds, 0.15));
+}
+
+TEST(TestSphereClearances, TestIntraGroupTravel)
+{
+  PropagationDistanceField df(size, size, size, resolution, 0.0, 0.0, 0.0, max_dist);
+  df.reset();
+
+  //two spheres 0.3 apart at both ends, well clear of the environment
+  std::vector<tf::Vector3> centers;
+  centers.push_back(tf::Vector3(0.35, 0.5, 0.5));
+  centers.push_back(tf::Vector3(0.65, 0.5, 0.5));
+  std::vector<double> intra_distances(2, 0.3-2.0*radius);
+  std::vector<GradientInfo> gradients_1(1, makeGradient(df, centers, intra_distances));
+  std::vector<GradientInfo> gradients_2(gradients_1);
+
+  std::vector<std::vector<double> > travel_bounds(1, std::vector<double>(2, 0.15));
+  EXPECT_TRUE(areSweptSpheresCovered(gradients_1, gradients_2, travel_bounds, 0.0));
+
+  //each sphere's own travel is covered, but both together can close the gap
+  travel_bounds[0][0] = travel_bounds[0][1] = 0.25;
+  EXPECT_FALSE(areSweptSpheresCovered(gradients_1, gradients_2, travel_bounds, 0.0));
+}
+
+TEST(TestSphereClearances, TestMarginPastSaturation)
+{
+  PropagationDistanceField df(size, size, size, resolution, 0.0, 0.0, 0.0, max_dist);
+  df.reset();
+
+  std::vector<GradientInfo> gradients(1, makeGradient(df, tf::Vector3(0.5, 0.5, 0.5)));
+  EXPECT_TRUE(areSpheresOutsideMargin(gradients, 0.2));
+
+  //nothing is near, but the saturated field can't show more than max_dist less the radius
+  EXPECT_FALSE(areSpheresOutsideMargin(gradients, max_dist-0.5*radius));
+  EXPECT_FALSE(areSpheresOutsideMargin(gradients, 2.0*max_dist));
+
+  //nor can spheres without clearances be shown clear at all
+  gradients[0].field_clearances.clear();
+  EXPECT_FALSE(areSpheresOutsideMargin(gradients, 0.0));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,190 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2010, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/** \author E. Gil Jones */
+
+/** \author E. Gil Jones */
+
+#include <cstdlib>
+#include <gtest/gtest.h>
+
+#include <collision_proximity/sphere_distance_kernel.h>
+
+using namespace collision_proximity;
+
+//float distances of spheres about a meter apart are good to a few ulps
+static const double float_eps = 1e-5;
+
+static double gen_rand(double min, double max)
+{
+  return min+(max-min)*(rand()/(RAND_MAX+1.0));
+}
+
+static std::vector<CollisionSphere> makeRandomSpheres(unsigned int num, const tf::Vector3& offset)
+{
+  std::vector<CollisionSphere> spheres;
+  for(unsigned int i = 0; i < num; i++) {
+    spheres.push_back(CollisionSphere(tf::Vector3(0.0, 0.0, 0.0), gen_rand(0.0, 0.1)));
+    spheres.back().center_ = offset+tf::Vector3(gen_rand(-0.5, 0.5), gen_rand(-0.5, 0.5), gen_rand(-0.5, 0.5));
+  }
+  return spheres;
+}
+
+static double getDistance(const CollisionSphere& s1, const CollisionSphere& s2, bool subtract_radii)
+{
+  double dist = s1.center_.distance(s2.center_);
+  if(subtract_radii) {
+    dist -= s1.radius_+s2.radius_;
+  }
+  return dist;
+}
+
+//the closest distance from the sphere to any of the others, in double
+static double getClosestDistance(const CollisionSphere& sphere, const std::vector<CollisionSphere>& others, bool subtract_radii)
+{
+  double closest = DBL_MAX;
+  for(unsigned int i = 0; i < others.size(); i++) {
+    closest = std::min(closest, getDistance(sphere, others[i], subtract_radii));
+  }
+  return closest;
+}
+
+static GradientInfo makeGradient(unsigned int num)
+{
+  GradientInfo gradient;
+  gradient.distances.resize(num, DBL_MAX);
+  gradient.gradients.resize(num);
+  return gradient;
+}
+
+//checks the kernel's closest spheres and the gradients from them against a brute force scan
+static void checkAgainstBruteForce(const std::vector<CollisionSphere>& rows, const std::vector<CollisionSphere>& columns,
+                                   bool subtract_radii, double tolerance)
+{
+  SphereBlock row_block, column_block;
+  row_block.setSpheres(rows);
+  column_block.setSpheres(columns);
+  SphereBlockDistances distances;
+  computeSphereBlockDistances(row_block, column_block, subtract_radii, distances);
+  ASSERT_EQ(distances.row_distances.size(), rows.size());
+  ASSERT_EQ(distances.column_distances.size(), columns.size());
+
+  SphereBlockDistances scratch_distances;
+  GradientInfo row_gradient = makeGradient(rows.size());
+  GradientInfo column_gradient = makeGradient(columns.size());
+  bool gradient_collision = updateSphereBlockGradients(rows, row_block, columns, column_block, subtract_radii, tolerance,
+                                                       row_gradient, column_gradient, scratch_distances);
+  bool collision = areSphereBlocksInCollision(rows, row_block, columns, column_block, tolerance, scratch_distances);
+
+  bool brute_collision = false;
+  double brute_row_closest = DBL_MAX;
+  for(unsigned int i = 0; i < rows.size(); i++) {
+    double closest = getClosestDistance(rows[i], columns, subtract_radii);
+    brute_row_closest = std::min(brute_row_closest, closest);
+    if(getClosestDistance(rows[i], columns, true) <= tolerance) {
+      brute_collision = true;
+    }
+    EXPECT_NEAR(distances.row_distances[i], closest, float_eps);
+    ASSERT_LT(distances.row_closest[i], columns.size());
+    EXPECT_NEAR(getDistance(rows[i], columns[distances.row_closest[i]], subtract_radii), closest, float_eps);
+    EXPECT_NEAR(row_gradient.distances[i], closest, float_eps);
+    //the gradient points away from the sphere the distance was measured to
+    const CollisionSphere& closest_sphere = columns[distances.row_closest[i]];
+    EXPECT_NEAR(row_gradient.distances[i], getDistance(rows[i], closest_sphere, subtract_radii), 1e-12);
+    EXPECT_LT((row_gradient.gradients[i]-(rows[i].center_-closest_sphere.center_)).length(), 1e-12);
+  }
+  EXPECT_NEAR(row_gradient.closest_distance, brute_row_closest, float_eps);
+  for(unsigned int i = 0; i < columns.size(); i++) {
+    double closest = getClosestDistance(columns[i], rows, subtract_radii);
+    EXPECT_NEAR(distances.column_distances[i], closest, float_eps);
+    ASSERT_LT(distances.column_closest[i], rows.size());
+    const CollisionSphere& closest_sphere = rows[distances.column_closest[i]];
+    EXPECT_NEAR(getDistance(columns[i], closest_sphere, subtract_radii), closest, float_eps);
+    EXPECT_NEAR(column_gradient.distances[i], closest, float_eps);
+    EXPECT_LT((column_gradient.gradients[i]-(columns[i].center_-closest_sphere.center_)).length(), 1e-12);
+  }
+  EXPECT_EQ(collision, brute_collision);
+  if(subtract_radii) {
+    EXPECT_EQ(gradient_collision, brute_collision);
+  }
+}
+
+TEST(TestSphereDistanceKernel, TestRandomSpheres)
+{
+  srand(0);
+  //none of these fill whole blocks, so the padding spheres are always there
+  const unsigned int counts[] = {1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 19};
+  const unsigned int num_counts = sizeof(counts)/sizeof(counts[0]);
+  for(unsigned int i = 0; i < num_counts; i++) {
+    for(unsigned int j = 0; j < num_counts; j++) {
+      for(unsigned int trial = 0; trial < 5; trial++) {
+        //overlapping sets, and sets apart so that only the padding would be in range
+        tf::Vector3 offset(0.0, 0.0, trial < 3 ? 0.0 : 0.6);
+        std::vector<CollisionSphere> rows = makeRandomSpheres(counts[i], tf::Vector3(0.0, 0.0, 0.0));
+        std::vector<CollisionSphere> columns = makeRandomSpheres(counts[j], offset);
+        SCOPED_TRACE(testing::Message() << counts[i] << " by " << counts[j] << " spheres, trial " << trial);
+        checkAgainstBruteForce(rows, columns, trial%2 == 0, 0.0);
+        checkAgainstBruteForce(rows, columns, true, 0.02);
+      }
+    }
+  }
+}
+
+TEST(TestSphereDistanceKernel, TestNearTolerance)
+{
+  //spheres just inside and just outside the tolerance, closer than float can tell apart
+  std::vector<CollisionSphere> rows(1, CollisionSphere(tf::Vector3(0.0, 0.0, 0.0), 0.05));
+  rows[0].center_ = tf::Vector3(0.3, 0.2, 0.1);
+  std::vector<CollisionSphere> columns(3, CollisionSphere(tf::Vector3(0.0, 0.0, 0.0), 0.05));
+  columns[0].center_ = tf::Vector3(0.9, 0.2, 0.1);
+  columns[1].center_ = tf::Vector3(-0.3, 0.2, 0.1);
+  columns[2].center_ = tf::Vector3(0.3, 0.2, 0.1+0.1+0.01+1e-9);
+
+  SphereBlock row_block, column_block;
+  row_block.setSpheres(rows);
+  column_block.setSpheres(columns);
+  SphereBlockDistances distances;
+  EXPECT_FALSE(areSphereBlocksInCollision(rows, row_block, columns, column_block, 0.01, distances));
+  columns[2].center_ = tf::Vector3(0.3, 0.2, 0.1+0.1+0.01-1e-9);
+  column_block.setSpheres(columns);
+  EXPECT_TRUE(areSphereBlocksInCollision(rows, row_block, columns, column_block, 0.01, distances));
+  checkAgainstBruteForce(rows, columns, true, 0.01);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
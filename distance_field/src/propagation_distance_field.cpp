@@ -111,6 +111,10 @@ void PropagationDistanceField::updatePointsInField(const std::vector<tf::Vector3
       }
     }
 
+   for( VoxelSet::const_iterator it=points_removed.begin(); it!=points_removed.end(); ++it)
+   {
+     object_voxel_locations_.erase(*it);
+   }
    removeObstacleVoxels( points_removed );
    addNewObstacleVoxels( points_added );
   }
@@ -196,7 +200,6 @@ void PropagationDistanceField::removeObstacleVoxels(const VoxelSet& locations )
   std::vector<int3> stack;
   int initial_update_direction = getDirectionNumber(0,0,0);
 
-  stack.reserve( num_cells_[DIM_X] * num_cells_[DIM_Y] * num_cells_[DIM_Z] );
   bucket_queue_[0].reserve(locations.size());
 
   // First reset the obstacle voxels,
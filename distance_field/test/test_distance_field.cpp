@@ -137,6 +137,11 @@ TEST(TestPropagationDistanceField, TestAddPoints)
   points.push_back(point1);
   df.updatePointsInField(points,true);
   //print(df, numX, numY, numZ);
+  check_distance_field( df, points, numX, numY, numZ);
+
+	// Update - iterative, re-adding the point removed above
+  points.push_back(point2);
+  df.updatePointsInField(points,true);
   check_distance_field( df, points, numX, numY, numZ);
 
 	// Update - not iterative